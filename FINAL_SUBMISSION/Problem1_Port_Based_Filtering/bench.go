@@ -0,0 +1,115 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"math/rand"
+	"strconv"
+
+	"filter-common/bench"
+	"filter-common/bpfmap"
+	"filter-common/sizing"
+	"github.com/cilium/ebpf"
+)
+
+// runBench measures the per-packet cost of tcp_port_filter with
+// BPF_PROG_TEST_RUN, for a pass and a drop case per protocol. The port is
+// blocked for TCP and UDP, and ICMP echo requests (any code) and
+// port-unreachable are blocked. With a blocklist size, that many random source
+// addresses are loaded first and the blocklist paths are measured too.
+// Usage: packet-filter bench [port] [blocklist-size]
+func runBench(args []string) {
+	port := uint16(4040)
+	if len(args) > 0 {
+		p, err := parsePort(args[0])
+		if err != nil {
+			log.Fatalf("Usage: packet-filter bench [port] [blocklist-size]: %v", err)
+		}
+		port = p
+	}
+	blocklistSize := 0
+	if len(args) > 1 {
+		n, err := strconv.Atoi(args[1])
+		if err != nil || n < 0 {
+			log.Fatalf("Usage: packet-filter bench [port] [blocklist-size]: invalid size %q", args[1])
+		}
+		blocklistSize = n
+	}
+
+	spec, err := loadSpec(false, blocklistCapacity(blocklistSize))
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	if err := sizing.SetupMemlock(spec, 0); err != nil {
+		log.Fatalf("Failed to remove memlock limit: %v", err)
+	}
+
+	objs, _, err := loadObjects(spec, "")
+	if err != nil {
+		log.Fatalf("Failed to load eBPF objects: %v", err)
+	}
+	defer objs.Close()
+
+	rules := []ruleKey{
+		newRuleKey(protoTCP, port),
+		newRuleKey(protoUDP, port),
+		newRuleKey(protoICMP, 8<<8|icmpCodeAny),
+		newRuleKey(protoICMP, 3<<8|3),
+	}
+	if err := bpfmap.BatchPut(objs.BlockedPortsMap, rules, []uint8{policyActive, policyActive, policyActive, policyActive}); err != nil {
+		log.Fatalf("Failed to configure rules: %v", err)
+	}
+
+	loopback := ipv4Key{127, 0, 0, 1}
+	cases := []bench.Case{
+		{Name: "non-ip", Pkt: bench.EthFrame(0x0806, 46), Want: bench.XDPPass},
+		{Name: "tcp pass", Pkt: bench.TCPPacket(loopback, loopback, port^1), Want: bench.XDPPass},
+		{Name: "tcp drop", Pkt: bench.TCPPacket(loopback, loopback, port), Want: bench.XDPDrop},
+		{Name: "udp pass", Pkt: bench.UDPPacket(loopback, loopback, port^1), Want: bench.XDPPass},
+		{Name: "udp drop", Pkt: bench.UDPPacket(loopback, loopback, port), Want: bench.XDPDrop},
+		{Name: "icmp pass", Pkt: bench.ICMPPacket(loopback, loopback, 0, 0), Want: bench.XDPPass},
+		{Name: "icmp drop", Pkt: bench.ICMPPacket(loopback, loopback, 8, 0), Want: bench.XDPDrop},
+		{Name: "icmp code", Pkt: bench.ICMPPacket(loopback, loopback, 3, 3), Want: bench.XDPDrop},
+		{Name: "other proto", Pkt: bench.IPv4Packet(loopback, loopback, 47, 4), Want: bench.XDPPass},
+	}
+
+	if blocklistSize > 0 {
+		// Random addresses in 10.0.0.0/8..223.0.0.0/8, never 127.0.0.1
+		rng := rand.New(rand.NewSource(1))
+		list := make(map[ipv4Key]uint8, blocklistSize)
+		for len(list) < blocklistSize {
+			list[ipv4Key{byte(10 + rng.Intn(100)), byte(rng.Intn(256)), byte(rng.Intn(256)), byte(rng.Intn(256))}] = policyActive
+		}
+		if err := applyBlocklist(objs.SrcBloomMap, objs.BlockedSrcMap, list); err != nil {
+			log.Fatalf("Failed to load blocklist: %v", err)
+		}
+		config := filterConfig{Mode: modeEnforce, Flags: configFlagSrcBlocklist}
+		if err := objs.ConfigMap.Put(uint32(0), config); err != nil {
+			log.Fatalf("Failed to configure filter: %v", err)
+		}
+
+		var listed ipv4Key
+		for listed = range list {
+			break
+		}
+		cases = append(cases,
+			bench.Case{Name: "src listed", Pkt: bench.TCPPacket(listed, loopback, port^1), Want: bench.XDPDrop},
+			bench.Case{Name: "src unlisted", Pkt: bench.TCPPacket(loopback, loopback, port^1), Want: bench.XDPPass},
+		)
+
+		for _, m := range []struct {
+			name string
+			m    *ebpf.Map
+		}{{"bloom filter", objs.SrcBloomMap}, {"exact hash", objs.BlockedSrcMap}} {
+			memlock, err := sizing.MapMemlock(m.m)
+			if err != nil {
+				log.Printf("Failed to read memlock of %s: %v", m.name, err)
+				continue
+			}
+			fmt.Printf("🧱 %-12s %8.1f MiB for %d addresses (%.1f B/address)\n", m.name,
+				float64(memlock)/(1<<20), blocklistSize, float64(memlock)/float64(blocklistSize))
+		}
+	}
+
+	bench.Run(objs.TcpPortFilter, cases)
+}
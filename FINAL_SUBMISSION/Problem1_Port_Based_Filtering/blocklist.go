@@ -0,0 +1,105 @@
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"log"
+	"net"
+	"os"
+	"strings"
+	"time"
+
+	"filter-common/bpfmap"
+	"github.com/cilium/ebpf"
+)
+
+// configFlagSrcBlocklist enables the source blocklist, as CONFIG_F_SRC_BLOCKLIST.
+const configFlagSrcBlocklist = 1 << 0
+
+// ipv4Key is an IPv4 address in network byte order, as the eBPF maps key it.
+type ipv4Key [4]byte
+
+// blocklistCapacity sizes the bloom filter and hash for n addresses, with
+// headroom so a reload can add entries without reloading the program.
+func blocklistCapacity(n int) uint32 {
+	return uint32(n + n/4 + 1024)
+}
+
+// loadBlocklist reads one IPv4 address per line. Blank lines and lines
+// starting with '#' are ignored.
+func loadBlocklist(path string) (map[ipv4Key]uint8, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	list := make(map[ipv4Key]uint8)
+	scanner := bufio.NewScanner(f)
+	for line := 1; scanner.Scan(); line++ {
+		text := strings.TrimSpace(scanner.Text())
+		if text == "" || strings.HasPrefix(text, "#") {
+			continue
+		}
+		ip := net.ParseIP(text).To4()
+		if ip == nil {
+			return nil, fmt.Errorf("%s:%d: invalid IPv4 address %q", path, line, text)
+		}
+		list[ipv4Key(ip)] = policyActive
+	}
+	return list, scanner.Err()
+}
+
+// applyBlocklist syncs the exact-match hash and adds new addresses to the
+// bloom filter. Bloom filters cannot delete, so removed addresses stay in
+// the filter as false positives until the next restart; the exact-match
+// hash still decides.
+func applyBlocklist(bloom, hash *ebpf.Map, list map[ipv4Key]uint8) error {
+	start := time.Now()
+
+	var (
+		ip       ipv4Key
+		policies uint8
+		current  = make(map[ipv4Key]bool)
+	)
+	iter := hash.Iterate()
+	for iter.Next(&ip, &policies) {
+		current[ip] = true
+	}
+	if err := iter.Err(); err != nil {
+		return fmt.Errorf("read blocklist: %w", err)
+	}
+	var added []ipv4Key
+	for ip := range list {
+		if !current[ip] {
+			added = append(added, ip)
+		}
+	}
+	for _, ip := range added {
+		if err := bloom.Put(nil, ip); err != nil {
+			return fmt.Errorf("add %s to bloom filter: %w", net.IP(ip[:]), err)
+		}
+	}
+
+	updated, deleted, err := bpfmap.Sync(hash, list)
+	if err != nil {
+		return err
+	}
+	fmt.Printf("⏱️  Synced %d blocklisted sources in %v (%d updated, %d deleted)\n",
+		len(list), time.Since(start), updated, deleted)
+	return nil
+}
+
+// showBlocklistStats prints blocklist hits and bloom filter false positives.
+func showBlocklistStats(statsMap *ebpf.Map) {
+	var matched, falsePositives uint64
+	if err := statsMap.Lookup(uint32(statSrcMatched), &matched); err != nil {
+		log.Printf("Failed to read blocklist statistics: %v", err)
+		return
+	}
+	if err := statsMap.Lookup(uint32(statBloomFP), &falsePositives); err != nil {
+		log.Printf("Failed to read blocklist statistics: %v", err)
+		return
+	}
+	fmt.Printf("🧱 Blocklist: matched=%d bloom false positives=%d\n", matched, falsePositives)
+}
@@ -0,0 +1,83 @@
+#!/bin/bash
+
+echo "🔨 Building Port-Based eBPF Filter"
+echo "==================================="
+
+# Colors for output
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+echo ""
+echo "📋 Objective: Drop TCP/UDP/ICMP traffic matching the configured rules"
+echo ""
+
+# Build one eBPF object for a target, stripped of DWARF but keeping the
+# BTF that map definitions and CO-RE need
+build_object() {
+    local out=$1 target=$2
+    shift 2
+    clang -target "$target" -O2 -g "$@" -c packet_filter.c -o "$out" &&
+        llvm-strip -g "$out" &&
+        llvm-readelf -S "$out" | grep -q '\.BTF'
+}
+
+# Build the eBPF program for little- and big-endian hosts
+for target in bpfel bpfeb; do
+    echo -e "${BLUE}Building eBPF program ($target)...${NC}"
+    if build_object packet_filter_$target.o $target; then
+        echo -e "${GREEN}✅ eBPF program compiled successfully${NC}"
+        ls -la packet_filter_$target.o
+    else
+        echo -e "${RED}❌ eBPF compilation failed${NC}"
+        exit 1
+    fi
+
+    # Build the trace variant (per-packet latency instrumentation)
+    echo -e "\n${BLUE}Building eBPF trace variant ($target)...${NC}"
+    if build_object packet_filter_trace_$target.o $target -DFILTER_TRACE; then
+        echo -e "${GREEN}✅ eBPF trace variant compiled successfully${NC}"
+        ls -la packet_filter_trace_$target.o
+    else
+        echo -e "${RED}❌ eBPF trace variant compilation failed${NC}"
+        exit 1
+    fi
+    echo ""
+done
+
+# Build the loader, embedding the same objects through bpf2go
+echo -e "${BLUE}Building loader...${NC}"
+if go generate && go build -o packet-filter .; then
+    echo -e "${GREEN}✅ Loader built successfully${NC}"
+    ls -la packet-filter
+else
+    echo -e "${RED}❌ Loader build failed${NC}"
+    exit 1
+fi
+
+# Load the programs through the verifier and check them against
+# verifier_budget.json (instructions, verified instructions, JITed bytes):
+# first the objects embedded by bpf2go, then the ones built above. Only
+# objects of the host's byte order can be loaded.
+host=bpfel
+[ "$(printf '\001\000' | od -An -tx2 | tr -d ' ')" = "0100" ] && host=bpfeb
+echo -e "\n${BLUE}Checking verifier budget...${NC}"
+if [ "$EUID" -ne 0 ]; then
+    echo "⚠️  Skipped: loading programs needs root (run: sudo ./build.sh)"
+elif ./packet-filter verify &&
+    ./packet-filter verify packet_filter_$host.o packet_filter_trace_$host.o; then
+    echo -e "${GREEN}✅ Verifier budget check passed${NC}"
+else
+    echo -e "${RED}❌ Verifier budget check failed${NC}"
+    exit 1
+fi
+
+echo -e "\n${GREEN}🎉 Build complete!${NC}"
+echo -e "${BLUE}Available executables:${NC}"
+echo "  - packet_filter_{bpfel,bpfeb}.o       (eBPF bytecode with BTF)"
+echo "  - packet_filter_trace_{bpfel,bpfeb}.o (eBPF bytecode, FILTER_TRACE build)"
+echo "  - packet-filter                       (Loader)"
+
+echo -e "\n${BLUE}Usage:${NC}"
+echo "  sudo ./packet-filter lo 4040   # Block TCP port 4040 on loopback"
@@ -0,0 +1,388 @@
+package main
+
+import (
+	"errors"
+	"fmt"
+	"log"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"strings"
+	"time"
+
+	"filter-common/bpfmap"
+	"filter-common/sizing"
+	"filter-common/traffic"
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/link"
+	"github.com/vishvananda/netlink"
+)
+
+// pinDir holds the maps and the XDP link pinned by "apply", so the filter
+// keeps running after the command exits and later commands can find it.
+const pinDir = "/sys/fs/bpf/packet-filter"
+
+// xdpLinkPrefix names the pinned XDP link after its interface.
+const xdpLinkPrefix = "xdp_"
+
+// runApply deploys a policy file, or updates the maps of a filter that is
+// already attached. Usage: packet-filter apply <policy.json>
+func runApply(args []string) {
+	if len(args) != 1 {
+		log.Fatalf("Usage: packet-filter apply <policy.json>")
+	}
+	policy, err := loadPolicy(args[0])
+	if err != nil {
+		log.Fatalf("Failed to load policy: %v", err)
+	}
+
+	start := time.Now()
+	if attached, ok := attachedInterface(); ok {
+		if attached != policy.iface {
+			log.Fatalf("Filter is attached to %s; run detach before moving it to %s", attached, policy.iface)
+		}
+		maps, err := loadPinnedMaps()
+		if err != nil {
+			log.Fatalf("Failed to open pinned maps: %v", err)
+		}
+		defer maps.Close()
+		if err := applyPolicy(maps, policy); err != nil {
+			log.Fatalf("Failed to apply policy: %v", err)
+		}
+		fmt.Printf("✅ Policy updated on %s in %v\n", policy.iface, time.Since(start))
+		return
+	}
+
+	// Undo a partial deployment before bailing out
+	abort := func(format string, v ...interface{}) {
+		os.RemoveAll(pinDir)
+		log.Fatalf(format, v...)
+	}
+
+	spec, err := loadSpec(false, blocklistCapacity(len(policy.blocklist)))
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	if err := sizing.SetupMemlock(spec, policy.budget); err != nil {
+		log.Fatalf("Failed to set memlock limit: %v", err)
+	}
+
+	iface, err := netlink.LinkByName(policy.iface)
+	if err != nil {
+		log.Fatalf("Failed to get interface %s: %v", policy.iface, err)
+	}
+
+	// Maps left behind without a link are from an interrupted apply
+	if err := os.RemoveAll(pinDir); err != nil {
+		log.Fatalf("Failed to clean %s: %v", pinDir, err)
+	}
+	if err := os.MkdirAll(pinDir, 0700); err != nil {
+		log.Fatalf("Failed to create %s (is bpffs mounted?): %v", pinDir, err)
+	}
+
+	objs, _, err := loadObjects(spec, pinDir)
+	if err != nil {
+		abort("Failed to load eBPF objects: %v", err)
+	}
+	defer objs.Close()
+
+	if err := applyPolicy(&objs.PacketFilterMaps, policy); err != nil {
+		abort("Failed to apply policy: %v", err)
+	}
+	if err := bpfmap.BatchPut(objs.StatsMap, []uint32{statTotal, statDropped, statSrcMatched, statBloomFP, statExpired, statExpiredSwept}, make([]uint64, statSlots)); err != nil {
+		abort("Failed to initialize statistics counters: %v", err)
+	}
+
+	l, err := link.AttachXDP(link.XDPOptions{
+		Program:   objs.TcpPortFilter,
+		Interface: iface.Attrs().Index,
+		Flags:     link.XDPGenericMode,
+	})
+	if err != nil {
+		abort("Failed to attach XDP program: %v", err)
+	}
+	defer l.Close()
+	if err := l.Pin(filepath.Join(pinDir, xdpLinkPrefix+policy.iface)); err != nil {
+		abort("Failed to pin XDP link (needs bpf_link support for XDP): %v", err)
+	}
+
+	fmt.Printf("✅ Packet filter attached to %s in %v, pinned at %s\n", policy.iface, time.Since(start), pinDir)
+	if sizes, err := sizing.Maps(namedMaps(&objs.PacketFilterMaps)); err == nil {
+		sizing.Print(sizes, policy.budget)
+	}
+}
+
+// runSize prints the map memory a policy file would need, without loading
+// anything. Usage: packet-filter size <policy.json>
+func runSize(args []string) {
+	if len(args) != 1 {
+		log.Fatalf("Usage: packet-filter size <policy.json>")
+	}
+	policy, err := loadPolicy(args[0])
+	if err != nil {
+		log.Fatalf("Failed to load policy: %v", err)
+	}
+	spec, err := loadSpec(false, blocklistCapacity(len(policy.blocklist)))
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	sizes, err := sizing.Spec(spec)
+	if err != nil {
+		log.Fatalf("Failed to size maps: %v", err)
+	}
+	sizing.Print(sizes, policy.budget)
+}
+
+// applyPolicy writes a compiled policy into the filter's maps, touching only
+// entries that changed.
+func applyPolicy(maps *PacketFilterMaps, policy *compiledPolicy) error {
+	// Temporary rules added with "block" survive until they expire
+	if err := sweepExpired(maps); err != nil {
+		return err
+	}
+	rules, tempPorts, err := mergeTemporary(policy.rules, maps.PortExpiryMap)
+	if err != nil {
+		return fmt.Errorf("temporary rules: %w", err)
+	}
+	blocklist, tempSources, err := mergeTemporary(policy.blocklist, maps.SrcExpiryMap)
+	if err != nil {
+		return fmt.Errorf("temporary source rules: %w", err)
+	}
+	config := policy.config
+	if tempPorts+tempSources > 0 {
+		config.Flags |= configFlagExpiry
+	}
+	if len(blocklist) > 0 {
+		config.Flags |= configFlagSrcBlocklist
+	}
+
+	// Check every size before writing anything, so a rejected policy
+	// leaves the filter as it was
+	if capacity := maps.BlockedPortsMap.MaxEntries(); uint32(len(rules)) > capacity {
+		return fmt.Errorf("%d port rules exceed the %d blocked_ports_map holds", len(rules), capacity)
+	}
+	if capacity := maps.BlockedSrcMap.MaxEntries(); uint32(len(blocklist)) > capacity {
+		return fmt.Errorf("blocklist of %d addresses exceeds the %d sized at attach time; run detach and apply again",
+			len(blocklist), capacity)
+	}
+
+	if err := applyPortRules(maps.BlockedPortsMap, rules); err != nil {
+		return fmt.Errorf("blocked ports: %w", err)
+	}
+	if err := applyBlocklist(maps.SrcBloomMap, maps.BlockedSrcMap, blocklist); err != nil {
+		return fmt.Errorf("blocklist: %w", err)
+	}
+	if err := maps.ConfigMap.Put(uint32(0), config); err != nil {
+		return fmt.Errorf("filter mode: %w", err)
+	}
+	return nil
+}
+
+// attachedInterface returns the interface of the pinned XDP link, if any.
+func attachedInterface() (string, bool) {
+	links, _ := filepath.Glob(filepath.Join(pinDir, xdpLinkPrefix+"*"))
+	if len(links) == 0 {
+		return "", false
+	}
+	return strings.TrimPrefix(filepath.Base(links[0]), xdpLinkPrefix), true
+}
+
+// namedMap ties a field of PacketFilterMaps to its map name.
+type namedMap struct {
+	name string
+	m    **ebpf.Map
+}
+
+func mapFields(maps *PacketFilterMaps) []namedMap {
+	return []namedMap{
+		{"blocked_ports_map", &maps.BlockedPortsMap},
+		{"stats_map", &maps.StatsMap},
+		{"queue_stats_map", &maps.QueueStatsMap},
+		{"traffic_stats_map", &maps.TrafficStatsMap},
+		{"config_map", &maps.ConfigMap},
+		{"rule_hits_map", &maps.RuleHitsMap},
+		{"policy_stats_map", &maps.PolicyStatsMap},
+		{"samples_map", &maps.SamplesMap},
+		{"src_bloom_map", &maps.SrcBloomMap},
+		{"blocked_src_map", &maps.BlockedSrcMap},
+		{"port_expiry_map", &maps.PortExpiryMap},
+		{"src_expiry_map", &maps.SrcExpiryMap},
+		{"talker_sketch_map", &maps.TalkerSketchMap},
+		{"talker_map", &maps.TalkerMap},
+	}
+}
+
+// namedMaps returns the loaded maps keyed by name, like Collection.Maps.
+func namedMaps(maps *PacketFilterMaps) map[string]*ebpf.Map {
+	byName := make(map[string]*ebpf.Map)
+	for _, f := range mapFields(maps) {
+		byName[f.name] = *f.m
+	}
+	return byName
+}
+
+// loadPinnedMaps opens the maps pinned by a previous apply.
+func loadPinnedMaps() (*PacketFilterMaps, error) {
+	maps := &PacketFilterMaps{}
+	for _, f := range mapFields(maps) {
+		m, err := ebpf.LoadPinnedMap(filepath.Join(pinDir, f.name), nil)
+		if err != nil {
+			maps.Close()
+			return nil, fmt.Errorf("%s: %w", f.name, err)
+		}
+		*f.m = m
+	}
+	return maps, nil
+}
+
+// readPortRules returns the contents of blocked_ports_map.
+func readPortRules(m *ebpf.Map) (map[ruleKey]uint8, error) {
+	var (
+		rule     ruleKey
+		policies uint8
+		rules    = make(map[ruleKey]uint8)
+	)
+	iter := m.Iterate()
+	for iter.Next(&rule, &policies) {
+		rules[rule] = policies
+	}
+	return rules, iter.Err()
+}
+
+// countEntries returns the number of keys in a hash map.
+func countEntries(m *ebpf.Map) (int, error) {
+	var (
+		key   []byte
+		value []byte
+		n     int
+	)
+	iter := m.Iterate()
+	for iter.Next(&key, &value) {
+		n++
+	}
+	return n, iter.Err()
+}
+
+// runStatus prints where the filter is attached and what it enforces.
+func runStatus() {
+	iface, ok := attachedInterface()
+	if !ok {
+		fmt.Printf("❌ Packet filter is not attached (nothing pinned at %s)\n", pinDir)
+		os.Exit(1)
+	}
+	maps, err := loadPinnedMaps()
+	if err != nil {
+		log.Fatalf("Failed to open pinned maps: %v", err)
+	}
+	defer maps.Close()
+	if err := sweepExpired(maps); err != nil {
+		log.Printf("Failed to sweep expired rules: %v", err)
+	}
+
+	var config filterConfig
+	if err := maps.ConfigMap.Lookup(uint32(0), &config); err != nil {
+		log.Fatalf("Failed to read filter mode: %v", err)
+	}
+	rules, err := readPortRules(maps.BlockedPortsMap)
+	if err != nil {
+		log.Fatalf("Failed to read port rules: %v", err)
+	}
+	var active, shadow int
+	for _, p := range rules {
+		if p&policyActive != 0 {
+			active++
+		}
+		if p&policyShadow != 0 {
+			shadow++
+		}
+	}
+	sources, err := countEntries(maps.BlockedSrcMap)
+	if err != nil {
+		log.Fatalf("Failed to read blocklist: %v", err)
+	}
+	var total, dropped uint64
+	maps.StatsMap.Lookup(uint32(statTotal), &total)
+	maps.StatsMap.Lookup(uint32(statDropped), &dropped)
+
+	mode := "enforce"
+	if config.Mode == modeMonitor {
+		mode = "monitor"
+	}
+	fmt.Printf("✅ Packet filter attached to %s (pinned at %s)\n", iface, pinDir)
+	fmt.Printf("📋 Mode: %s | rules: %d active, %d shadow | blocklist: %d/%d source(s) | sample rate %d\n",
+		mode, active, shadow, sources, maps.BlockedSrcMap.MaxEntries(), config.SampleRate)
+	fmt.Printf("📈 Since attach: seen=%d dropped=%d\n", total, dropped)
+	showTemporaryRules(maps)
+	if sizes, err := sizing.Maps(namedMaps(maps)); err != nil {
+		log.Printf("Failed to read map memory: %v", err)
+	} else {
+		sizing.Print(sizes, 0)
+	}
+}
+
+// runStats prints live rates from the pinned maps until interrupted.
+func runStats() {
+	if _, ok := attachedInterface(); !ok {
+		fmt.Printf("❌ Packet filter is not attached (nothing pinned at %s)\n", pinDir)
+		os.Exit(1)
+	}
+	maps, err := loadPinnedMaps()
+	if err != nil {
+		log.Fatalf("Failed to open pinned maps: %v", err)
+	}
+	defer maps.Close()
+
+	rates := traffic.NewPrinter(maps.TrafficStatsMap, maps.QueueStatsMap, nil)
+	policy := newPolicyReporter(maps.PolicyStatsMap, maps.RuleHitsMap)
+	talkers := newTalkerReporter(maps.TalkerSketchMap, maps.TalkerMap)
+	fmt.Printf("📈 Statistics will be shown every %v, press Ctrl+C to stop\n", traffic.Interval)
+
+	ticker := time.NewTicker(traffic.Interval)
+	defer ticker.Stop()
+	c := make(chan os.Signal, 1)
+	signal.Notify(c, os.Interrupt)
+	for {
+		select {
+		case <-ticker.C:
+			rules, err := readPortRules(maps.BlockedPortsMap)
+			if err != nil {
+				log.Printf("Failed to read port rules: %v", err)
+			}
+			rates.Print(traffic.Interval)
+			policy.print(rules, traffic.Interval)
+			talkers.print(traffic.Interval)
+			showBlocklistStats(maps.StatsMap)
+			if err := sweepExpired(maps); err != nil {
+				log.Printf("Failed to sweep expired rules: %v", err)
+			}
+		case <-c:
+			return
+		}
+	}
+}
+
+// runDetach removes the XDP link and all pinned maps.
+func runDetach() {
+	iface, ok := attachedInterface()
+	if ok {
+		l, err := link.LoadPinnedLink(filepath.Join(pinDir, xdpLinkPrefix+iface), nil)
+		if err != nil && !errors.Is(err, os.ErrNotExist) {
+			log.Fatalf("Failed to open pinned XDP link: %v", err)
+		}
+		if l != nil {
+			// Dropping the pin and the last fd detaches the program
+			if err := l.Unpin(); err != nil {
+				log.Fatalf("Failed to unpin XDP link: %v", err)
+			}
+			l.Close()
+		}
+	}
+	if err := os.RemoveAll(pinDir); err != nil {
+		log.Fatalf("Failed to remove %s: %v", pinDir, err)
+	}
+	if ok {
+		fmt.Printf("🛑 Packet filter detached from %s\n", iface)
+	} else {
+		fmt.Printf("🛑 Packet filter was not attached; cleaned %s\n", pinDir)
+	}
+}
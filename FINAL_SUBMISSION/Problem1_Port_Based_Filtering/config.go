@@ -0,0 +1,140 @@
+package main
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"net"
+	"os"
+	"path/filepath"
+
+	"filter-common/sizing"
+)
+
+// policyFile is the declarative policy read by "apply". packet-filter and
+// process-filter share the format; each enforces its own sections and
+// only checks that the others are well-formed JSON.
+//
+//	{
+//	  "interface": "eth0",
+//	  "mode": "enforce",
+//	  "sample_rate": 100,
+//	  "talkers_pass": true,
+//	  "ports": {"block": "4040,udp/53,icmp/8", "shadow": "candidate.txt"},
+//	  "blocklist": ["203.0.113.7"],
+//	  "blocklist_file": "abusers.txt",
+//	  "memlock_budget": "64MiB",
+//	  "cgroup": "/sys/fs/cgroup",
+//	  "processes": [
+//	    {"select": "comm:myprocess", "allow": "4040"},
+//	    {"select": "comm:nginx", "allow": "80,443"}
+//	  ]
+//	}
+type policyFile struct {
+	Interface     string    `json:"interface"`
+	Mode          string    `json:"mode"`
+	SampleRate    uint32    `json:"sample_rate"`
+	TalkersPass   bool      `json:"talkers_pass"`
+	Ports         portsSpec `json:"ports"`
+	Blocklist     []string  `json:"blocklist"`
+	BlocklistFile string    `json:"blocklist_file"`
+	MemlockBudget string    `json:"memlock_budget"`
+
+	// Enforced by process-filter
+	Cgroup    json.RawMessage `json:"cgroup"`
+	Processes json.RawMessage `json:"processes"`
+}
+
+// portsSpec holds the active and shadow rule sets, each a rule list or a
+// rules file as on the command line.
+type portsSpec struct {
+	Block  string `json:"block"`
+	Shadow string `json:"shadow"`
+}
+
+// compiledPolicy is a policy file turned into map contents.
+type compiledPolicy struct {
+	iface     string
+	config    filterConfig
+	rules     map[ruleKey]uint8
+	blocklist map[ipv4Key]uint8
+	budget    uint64
+}
+
+// loadPolicy reads a policy file and compiles it in one pass. Unknown keys
+// are rejected so that a typo does not silently drop a rule.
+func loadPolicy(path string) (*compiledPolicy, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	var pf policyFile
+	dec := json.NewDecoder(bytes.NewReader(data))
+	dec.DisallowUnknownFields()
+	if err := dec.Decode(&pf); err != nil {
+		return nil, fmt.Errorf("%s: %w", path, err)
+	}
+
+	policy := &compiledPolicy{
+		iface:  pf.Interface,
+		config: filterConfig{SampleRate: pf.SampleRate},
+	}
+	if policy.iface == "" {
+		policy.iface = "lo"
+	}
+	switch pf.Mode {
+	case "", "enforce":
+		policy.config.Mode = modeEnforce
+	case "monitor":
+		policy.config.Mode = modeMonitor
+	default:
+		return nil, fmt.Errorf("%s: unknown mode %q (want enforce or monitor)", path, pf.Mode)
+	}
+
+	if pf.TalkersPass {
+		policy.config.Flags |= configFlagTalkersPass
+	}
+
+	if policy.budget, err = sizing.ParseSize(pf.MemlockBudget); err != nil {
+		return nil, fmt.Errorf("%s: memlock_budget: %w", path, err)
+	}
+
+	// Files named in the policy are relative to the policy file. A rule
+	// source is only a file if one exists there; otherwise it is a list.
+	dir := filepath.Dir(path)
+	ruleSource := func(src string) string {
+		if src == "" || filepath.IsAbs(src) {
+			return src
+		}
+		if _, err := os.Stat(filepath.Join(dir, src)); err == nil {
+			return filepath.Join(dir, src)
+		}
+		return src
+	}
+	sources := policySources{active: ruleSource(pf.Ports.Block), shadow: ruleSource(pf.Ports.Shadow)}
+	if policy.rules, err = sources.load(); err != nil {
+		return nil, fmt.Errorf("%s: %w", path, err)
+	}
+
+	policy.blocklist = make(map[ipv4Key]uint8, len(pf.Blocklist))
+	if pf.BlocklistFile != "" {
+		file := pf.BlocklistFile
+		if !filepath.IsAbs(file) {
+			file = filepath.Join(dir, file)
+		}
+		if policy.blocklist, err = loadBlocklist(file); err != nil {
+			return nil, fmt.Errorf("%s: %w", path, err)
+		}
+	}
+	for _, addr := range pf.Blocklist {
+		ip := net.ParseIP(addr).To4()
+		if ip == nil {
+			return nil, fmt.Errorf("%s: invalid IPv4 address %q in blocklist", path, addr)
+		}
+		policy.blocklist[ipv4Key(ip)] = policyActive
+	}
+	if len(policy.blocklist) > 0 {
+		policy.config.Flags |= configFlagSrcBlocklist
+	}
+	return policy, nil
+}
@@ -0,0 +1,249 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"net"
+	"sort"
+	"time"
+
+	"filter-common/bpfmap"
+	"github.com/cilium/ebpf"
+	"golang.org/x/sys/unix"
+)
+
+// configFlagExpiry enables expiry checks on matches, as CONFIG_F_EXPIRY.
+const configFlagExpiry = 1 << 1
+
+// monotonicNow reads CLOCK_MONOTONIC, the clock of bpf_ktime_get_ns.
+func monotonicNow() uint64 {
+	var ts unix.Timespec
+	if err := unix.ClockGettime(unix.CLOCK_MONOTONIC, &ts); err != nil {
+		log.Fatalf("Failed to read monotonic clock: %v", err)
+	}
+	return uint64(ts.Nano())
+}
+
+// mergeTemporary returns desired plus the unexpired temporary rules in the
+// expiry map, so that syncing a policy does not remove them. A rule that is
+// also active in desired becomes permanent and loses its expiry.
+func mergeTemporary[K comparable](desired map[K]uint8, expiry *ebpf.Map) (map[K]uint8, int, error) {
+	var (
+		key       K
+		expires   uint64
+		now       = monotonicNow()
+		merged    = make(map[K]uint8, len(desired))
+		permanent []K
+		temporary int
+	)
+	for k, v := range desired {
+		merged[k] = v
+	}
+	iter := expiry.Iterate()
+	for iter.Next(&key, &expires) {
+		if desired[key]&policyActive != 0 {
+			permanent = append(permanent, key)
+		} else if expires > now {
+			merged[key] |= policyActive
+			temporary++
+		}
+	}
+	if err := iter.Err(); err != nil {
+		return nil, 0, fmt.Errorf("read expiry map: %w", err)
+	}
+	return merged, temporary, bpfmap.BatchDelete(expiry, permanent)
+}
+
+// sweepMap expires the rules whose deadline has passed: their expiry
+// entries are removed and the rules lose policyActive, which is all
+// "block" added. Rules left in no policy are deleted, the rest keep their
+// shadow membership. Only the expiry map is scanned, and it holds
+// temporary rules alone.
+func sweepMap[K comparable](expiry, rules *ebpf.Map) (int, error) {
+	var (
+		key      K
+		expires  uint64
+		now      = monotonicNow()
+		expired  []K
+		keepKeys []K
+		keepVals []uint8
+		delKeys  []K
+	)
+	iter := expiry.Iterate()
+	for iter.Next(&key, &expires) {
+		if expires <= now {
+			expired = append(expired, key)
+		}
+	}
+	if err := iter.Err(); err != nil {
+		return 0, fmt.Errorf("read expiry map: %w", err)
+	}
+	for _, k := range expired {
+		var policies uint8
+		if err := rules.Lookup(k, &policies); err != nil {
+			continue // already expired by a packet
+		}
+		if rest := policies &^ policyActive; rest != 0 {
+			keepKeys = append(keepKeys, k)
+			keepVals = append(keepVals, rest)
+		} else {
+			delKeys = append(delKeys, k)
+		}
+	}
+	if err := bpfmap.BatchDelete(expiry, expired); err != nil {
+		return 0, err
+	}
+	if err := bpfmap.BatchPut(rules, keepKeys, keepVals); err != nil {
+		return 0, err
+	}
+	return len(expired), bpfmap.BatchDelete(rules, delKeys)
+}
+
+// sweepExpired garbage-collects expired port/ICMP and source rules and adds
+// them to the swept counter in stats_map. The eBPF program already ignores
+// expired rules, so this only reclaims their map entries.
+func sweepExpired(maps *PacketFilterMaps) error {
+	ports, err := sweepMap[ruleKey](maps.PortExpiryMap, maps.BlockedPortsMap)
+	if err != nil {
+		return fmt.Errorf("sweep port rules: %w", err)
+	}
+	sources, err := sweepMap[ipv4Key](maps.SrcExpiryMap, maps.BlockedSrcMap)
+	if err != nil {
+		return fmt.Errorf("sweep source rules: %w", err)
+	}
+	if ports+sources == 0 {
+		return nil
+	}
+
+	// The eBPF program never writes this slot, so read-modify-write is safe
+	var swept uint64
+	if err := maps.StatsMap.Lookup(uint32(statExpiredSwept), &swept); err != nil {
+		return err
+	}
+	return maps.StatsMap.Put(uint32(statExpiredSwept), swept+uint64(ports+sources))
+}
+
+// runBlock adds a temporary rule to the attached filter.
+// Usage: packet-filter block <rule|ipv4> <duration>
+func runBlock(args []string) {
+	if len(args) != 2 {
+		log.Fatalf("Usage: packet-filter block <rule|ipv4> <duration>")
+	}
+	d, err := time.ParseDuration(args[1])
+	if err != nil || d <= 0 {
+		log.Fatalf("Usage: packet-filter block <rule|ipv4> <duration>: invalid duration %q", args[1])
+	}
+	if _, ok := attachedInterface(); !ok {
+		log.Fatalf("Packet filter is not attached; run apply first")
+	}
+	maps, err := loadPinnedMaps()
+	if err != nil {
+		log.Fatalf("Failed to open pinned maps: %v", err)
+	}
+	defer maps.Close()
+
+	var config filterConfig
+	if err := maps.ConfigMap.Lookup(uint32(0), &config); err != nil {
+		log.Fatalf("Failed to read filter configuration: %v", err)
+	}
+	config.Flags |= configFlagExpiry
+	expires := monotonicNow() + uint64(d)
+
+	// The expiry is written before the rule so that the rule is never
+	// briefly permanent
+	if ip := net.ParseIP(args[0]).To4(); ip != nil {
+		key := ipv4Key(ip)
+		if permanentRule(maps.BlockedSrcMap, maps.SrcExpiryMap, key) {
+			fmt.Printf("🧱 %s is already blocked permanently\n", args[0])
+			return
+		}
+		if err := maps.SrcExpiryMap.Put(key, expires); err != nil {
+			log.Fatalf("Failed to set expiry: %v", err)
+		}
+		if err := maps.SrcBloomMap.Put(nil, key); err != nil {
+			log.Fatalf("Failed to add %s to bloom filter: %v", args[0], err)
+		}
+		var policies uint8
+		maps.BlockedSrcMap.Lookup(key, &policies)
+		if err := maps.BlockedSrcMap.Put(key, policies|policyActive); err != nil {
+			log.Fatalf("Failed to block %s: %v", args[0], err)
+		}
+		config.Flags |= configFlagSrcBlocklist
+	} else {
+		rule, err := parseRule(args[0])
+		if err != nil {
+			log.Fatalf("Usage: packet-filter block <rule|ipv4> <duration>: %v", err)
+		}
+		if permanentRule(maps.BlockedPortsMap, maps.PortExpiryMap, rule) {
+			fmt.Printf("🧱 %s is already blocked permanently\n", rule)
+			return
+		}
+		var policies uint8
+		maps.BlockedPortsMap.Lookup(rule, &policies)
+		if err := maps.PortExpiryMap.Put(rule, expires); err != nil {
+			log.Fatalf("Failed to set expiry: %v", err)
+		}
+		if err := maps.BlockedPortsMap.Put(rule, policies|policyActive); err != nil {
+			log.Fatalf("Failed to block %s: %v", rule, err)
+		}
+	}
+	if err := maps.ConfigMap.Put(uint32(0), config); err != nil {
+		log.Fatalf("Failed to enable expiry checks: %v", err)
+	}
+	if err := sweepExpired(maps); err != nil {
+		log.Printf("Failed to sweep expired rules: %v", err)
+	}
+	fmt.Printf("⏳ Blocking %s for %v (until %s)\n", args[0], d, time.Now().Add(d).Format(time.TimeOnly))
+}
+
+// permanentRule reports whether key has an active rule without an expiry.
+func permanentRule[K comparable](rules, expiry *ebpf.Map, key K) bool {
+	var (
+		policies uint8
+		expires  uint64
+	)
+	if err := rules.Lookup(key, &policies); err != nil || policies&policyActive == 0 {
+		return false
+	}
+	return expiry.Lookup(key, &expires) != nil
+}
+
+// showTemporaryRules lists temporary rules with their remaining time and
+// the expiration counters.
+func showTemporaryRules(maps *PacketFilterMaps) {
+	type tempRule struct {
+		name string
+		left time.Duration
+	}
+	var rules []tempRule
+	now := monotonicNow()
+	remaining := func(expires uint64) time.Duration {
+		if expires <= now {
+			return 0
+		}
+		return time.Duration(expires - now).Round(time.Second)
+	}
+
+	var (
+		rule    ruleKey
+		src     ipv4Key
+		expires uint64
+	)
+	iter := maps.PortExpiryMap.Iterate()
+	for iter.Next(&rule, &expires) {
+		rules = append(rules, tempRule{rule.String(), remaining(expires)})
+	}
+	iter = maps.SrcExpiryMap.Iterate()
+	for iter.Next(&src, &expires) {
+		rules = append(rules, tempRule{fmt.Sprintf("source %s", net.IP(src[:])), remaining(expires)})
+	}
+	sort.Slice(rules, func(i, j int) bool { return rules[i].left < rules[j].left })
+
+	var hit, swept uint64
+	maps.StatsMap.Lookup(uint32(statExpired), &hit)
+	maps.StatsMap.Lookup(uint32(statExpiredSwept), &swept)
+	fmt.Printf("⏳ Temporary rules: %d | expired: %d on hit, %d swept\n", len(rules), hit, swept)
+	for _, r := range rules {
+		fmt.Printf("   %-22s %v left\n", r.name, r.left)
+	}
+}
@@ -1,89 +1,278 @@
 package main
 
 import (
+	"flag"
 	"fmt"
 	"log"
 	"os"
 	"os/signal"
-	"strconv"
+	"syscall"
+	"time"
 
-	"github.com/cilium/ebpf/link"
-	"github.com/cilium/ebpf/rlimit"
-	"github.com/vishvananda/netlink"
+	"filter-common/attach"
+	"filter-common/bpfmap"
+	"filter-common/sizing"
+	"filter-common/trace"
+	"filter-common/traffic"
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/ringbuf"
 )
 
-//go:generate go run github.com/cilium/ebpf/cmd/bpf2go -cc clang -no-strip PacketFilter packet_filter.c
+//go:generate go run github.com/cilium/ebpf/cmd/bpf2go -cc clang -target bpfel,bpfeb PacketFilter packet_filter.c
+//go:generate go run github.com/cilium/ebpf/cmd/bpf2go -cc clang -target bpfel,bpfeb -cflags -DFILTER_TRACE PacketFilterTrace packet_filter.c
 
 func main() {
+	if len(os.Args) > 1 {
+		switch os.Args[1] {
+		case "apply":
+			runApply(os.Args[2:])
+			return
+		case "status":
+			runStatus()
+			return
+		case "stats":
+			runStats()
+			return
+		case "detach":
+			runDetach()
+			return
+		case "size":
+			runSize(os.Args[2:])
+			return
+		case "block":
+			runBlock(os.Args[2:])
+			return
+		case "bench":
+			runBench(os.Args[2:])
+			return
+		case "verify":
+			runVerify(os.Args[2:])
+			return
+		}
+	}
+
 	// Parse command line arguments
+	monitor := flag.Bool("monitor", false, "evaluate and count rules, but never drop (dry run)")
+	shadow := flag.String("shadow", "", "candidate policy (rule list or rules file) counted alongside the active one")
+	sampleRate := flag.Uint("sample", 0, "sample 1 in N rule matches to userspace (0 = off)")
+	blocklistFile := flag.String("blocklist", "", "file of IPv4 source addresses to drop (bloom filter + exact match)")
+	traceBuild := flag.Bool("trace", false, "load the FILTER_TRACE build and show per-path latency histograms")
+	talkersPass := flag.Bool("talkers-pass", false, "count passed packets in the top-talkers report, not only drops")
+	memlockBudget := flag.String("memlock-budget", "", "warn when maps need more kernel memory than this, and cap RLIMIT_MEMLOCK to it (e.g. 64MiB)")
+	flag.Usage = func() {
+		fmt.Printf("Usage: %s apply <policy.json> | status | stats | detach | size <policy.json>\n", os.Args[0])
+		fmt.Printf("       %s block <rule|ipv4> <duration>\n", os.Args[0])
+		fmt.Printf("       %s bench [port] [blocklist-size]\n", os.Args[0])
+		fmt.Printf("       %s verify [-record] [-budget budget.json] [object.o ...]\n", os.Args[0])
+		fmt.Printf("       %s [flags] [interface[,...]] [rule[,rule...] | rules-file]\n", os.Args[0])
+		fmt.Printf("       interface: eth0 | eth0@PID | eth0@/run/netns/NAME | 'veth*' (host-side veths, followed)\n")
+		fmt.Printf("       A host-side veth sees what its container sends; use eth0@PID for what it receives\n")
+		fmt.Printf("Example: %s apply policy.json\n", os.Args[0])
+		fmt.Printf("Example: %s lo 8080\n", os.Args[0])
+		fmt.Printf("Example: %s lo 4040,8080,9090\n", os.Args[0])
+		fmt.Printf("Example: %s lo tcp/4040,udp/53,icmp/8\n", os.Args[0])
+		fmt.Printf("Example: %s -monitor -shadow candidate.txt eth0 blocked_ports.txt\n", os.Args[0])
+		fmt.Printf("Example: %s -blocklist abusers.txt eth0 4040\n", os.Args[0])
+		fmt.Printf("Example: %s 'eth0@1234,veth*' 4040\n", os.Args[0])
+		flag.PrintDefaults()
+	}
+	flag.Parse()
+
 	interfaceName := "lo"
-	targetPort := uint16(4040)
-	
-	if len(os.Args) > 1 {
-		interfaceName = os.Args[1]
-	}
-	if len(os.Args) > 2 {
-		port, err := strconv.Atoi(os.Args[2])
-		if err != nil || port < 1 || port > 65535 {
-			fmt.Printf("Usage: %s [interface] [port]\n", os.Args[0])
-			fmt.Printf("Example: %s lo 8080\n", os.Args[0])
-			os.Exit(1)
+	sources := policySources{active: "4040", shadow: *shadow}
+	if flag.NArg() > 0 {
+		interfaceName = flag.Arg(0)
+	}
+	if flag.NArg() > 1 {
+		sources.active = flag.Arg(1)
+	}
+	portRules, err := sources.load()
+	if err != nil {
+		fmt.Printf("Error: %v\n", err)
+		flag.Usage()
+		os.Exit(1)
+	}
+	config := filterConfig{Mode: modeEnforce, SampleRate: uint32(*sampleRate)}
+	if *monitor {
+		config.Mode = modeMonitor
+	}
+	if *talkersPass {
+		config.Flags |= configFlagTalkersPass
+	}
+	var blocklist map[ipv4Key]uint8
+	if *blocklistFile != "" {
+		if blocklist, err = loadBlocklist(*blocklistFile); err != nil {
+			log.Fatalf("Failed to load blocklist: %v", err)
 		}
-		targetPort = uint16(port)
+		config.Flags |= configFlagSrcBlocklist
 	}
 
-	// Remove memory limit for eBPF
-	if err := rlimit.RemoveMemlock(); err != nil {
-		log.Fatalf("Failed to remove memlock limit: %v", err)
+	budget, err := sizing.ParseSize(*memlockBudget)
+	if err != nil {
+		log.Fatalf("Invalid -memlock-budget: %v", err)
 	}
 
-	// Load the compiled eBPF program and maps
-	objs := PacketFilterObjects{}
-	if err := LoadPacketFilterObjects(&objs, nil); err != nil {
+	// Load the compiled eBPF program and maps, within the memory budget
+	spec, err := loadSpec(*traceBuild, blocklistCapacity(len(blocklist)))
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	if err := sizing.SetupMemlock(spec, budget); err != nil {
+		log.Fatalf("Failed to set memlock limit: %v", err)
+	}
+	objs, traceEvents, err := loadObjects(spec, "")
+	if err != nil {
 		log.Fatalf("Failed to load eBPF objects: %v", err)
 	}
 	defer objs.Close()
+	if traceEvents != nil {
+		defer traceEvents.Close()
+	}
+	if sizes, err := sizing.Maps(namedMaps(&objs.PacketFilterMaps)); err == nil {
+		sizing.Print(sizes, budget)
+	}
 
-	// Get network interface
-	iface, err := netlink.LinkByName(interfaceName)
+	targets, err := attach.ParseTargets(interfaceName)
 	if err != nil {
-		log.Fatalf("Failed to get interface %s: %v", interfaceName, err)
+		log.Fatalf("Invalid interface: %v", err)
 	}
 
-	// Configure the port to block in the eBPF map
-	key := uint32(0)
-	if err := objs.BlockedPortMap.Put(key, targetPort); err != nil {
-		log.Fatalf("Failed to configure blocked port: %v", err)
+	// Configure the ports to block in the eBPF map
+	if err := applyPortRules(objs.BlockedPortsMap, portRules); err != nil {
+		log.Fatalf("Failed to configure blocked ports: %v", err)
 	}
 
-	// Initialize statistics map
-	zero := uint64(0)
-	if err := objs.StatsMap.Put(uint32(0), zero); err != nil {
-		log.Fatalf("Failed to initialize total counter: %v", err)
+	// Load the source blocklist
+	if blocklist != nil {
+		if err := applyBlocklist(objs.SrcBloomMap, objs.BlockedSrcMap, blocklist); err != nil {
+			log.Fatalf("Failed to load blocklist: %v", err)
+		}
+	}
+
+	// Configure the filter mode
+	if err := objs.ConfigMap.Put(uint32(0), config); err != nil {
+		log.Fatalf("Failed to configure filter mode: %v", err)
 	}
-	if err := objs.StatsMap.Put(uint32(1), zero); err != nil {
-		log.Fatalf("Failed to initialize dropped counter: %v", err)
+
+	// Initialize statistics map
+	if err := bpfmap.BatchPut(objs.StatsMap, []uint32{statTotal, statDropped, statSrcMatched, statBloomFP, statExpired, statExpiredSwept}, make([]uint64, statSlots)); err != nil {
+		log.Fatalf("Failed to initialize statistics counters: %v", err)
 	}
 
-	// Attach XDP program to interface
-	l, err := link.AttachXDP(link.XDPOptions{
-		Program:   objs.TcpPortFilter,
-		Interface: iface.Attrs().Index,
-		Flags:     link.XDPGenericMode,
-	})
-	if err != nil {
+	// Attach the XDP program to every target; all of them share the maps
+	attacher := attach.New(objs.TcpPortFilter)
+	defer attacher.Close()
+	done := make(chan struct{})
+	defer close(done)
+	if err := attacher.Attach(targets, done); err != nil {
 		log.Fatalf("Failed to attach XDP program: %v", err)
 	}
-	defer l.Close()
 
-	fmt.Printf("✅ Packet filter loaded on %s, blocking TCP port %d\n", interfaceName, targetPort)
-	fmt.Printf("📊 Filtering active - packets to port %d will be dropped\n", targetPort)
+	// Print sampled rule matches
+	if config.SampleRate > 0 {
+		rd, err := ringbuf.NewReader(objs.SamplesMap)
+		if err != nil {
+			log.Fatalf("Failed to open sample reader: %v", err)
+		}
+		defer rd.Close()
+		go readSamples(rd)
+	}
+
+	// Collect per-packet trace events
+	tracer := trace.NewCollector(tracePathNames)
+	if traceEvents != nil {
+		rd, err := trace.NewReader(traceEvents)
+		if err != nil {
+			log.Fatalf("Failed to open trace reader: %v", err)
+		}
+		defer rd.Close()
+		go tracer.Run(rd)
+	}
+
+	fmt.Printf("✅ Packet filter loaded on %s, %d rule(s)\n", interfaceName, len(portRules))
+	if config.Mode == modeMonitor {
+		fmt.Printf("👀 Monitor mode - rule matches are counted, nothing is dropped\n")
+	} else {
+		fmt.Printf("📊 Filtering active - packets matching a rule will be dropped\n")
+	}
+	if blocklist != nil {
+		fmt.Printf("🧱 Dropping traffic from %d blocklisted source(s)\n", len(blocklist))
+	}
+	if sources.shadow != "" {
+		fmt.Printf("🔍 Shadow policy %s is counted alongside the active one\n", sources.shadow)
+	}
+	fmt.Printf("📈 Statistics will be shown every %v\n", traffic.Interval)
+	fmt.Printf("🔄 Send SIGHUP to reload rules files\n")
 	fmt.Printf("Press Ctrl+C to stop\n")
 
-	// Wait for interrupt signal
+	// Print live per-queue statistics until interrupted, reloading the
+	// rules file on SIGHUP
+	ticker := time.NewTicker(traffic.Interval)
+	defer ticker.Stop()
+
 	c := make(chan os.Signal, 1)
-	signal.Notify(c, os.Interrupt)
-	<-c
+	signal.Notify(c, os.Interrupt, syscall.SIGHUP)
+
+	rates := traffic.NewPrinter(objs.TrafficStatsMap, objs.QueueStatsMap, attacher.Label)
+	policy := newPolicyReporter(objs.PolicyStatsMap, objs.RuleHitsMap)
+	talkers := newTalkerReporter(objs.TalkerSketchMap, objs.TalkerMap)
+loop:
+	for {
+		select {
+		case <-ticker.C:
+			rates.Print(traffic.Interval)
+			policy.print(portRules, traffic.Interval)
+			talkers.print(traffic.Interval)
+			if blocklist != nil {
+				showBlocklistStats(objs.StatsMap)
+			}
+			if traceEvents != nil {
+				tracer.Print()
+			}
+		case sig := <-c:
+			if sig != syscall.SIGHUP {
+				break loop
+			}
+			rules, err := sources.load()
+			if err != nil {
+				log.Printf("Failed to reload rules: %v", err)
+				continue
+			}
+			if err := applyPortRules(objs.BlockedPortsMap, rules); err != nil {
+				log.Printf("Failed to apply reloaded rules: %v", err)
+				continue
+			}
+			portRules = rules
+
+			if blocklist == nil {
+				continue
+			}
+			list, err := loadBlocklist(*blocklistFile)
+			if err != nil {
+				log.Printf("Failed to reload blocklist: %v", err)
+				continue
+			}
+			if err := applyBlocklist(objs.SrcBloomMap, objs.BlockedSrcMap, list); err != nil {
+				log.Printf("Failed to apply reloaded blocklist: %v", err)
+			}
+		}
+	}
 
 	fmt.Printf("\n🛑 Shutting down packet filter...\n")
+	if traceEvents != nil {
+		tracer.Print()
+	}
+}
+
+// applyPortRules syncs the rule set into the kernel and reports how
+// long it took and how many entries actually changed.
+func applyPortRules(m *ebpf.Map, rules map[ruleKey]uint8) error {
+	start := time.Now()
+	updated, deleted, err := bpfmap.Sync(m, rules)
+	if err != nil {
+		return err
+	}
+	fmt.Printf("⏱️  Synced %d rules in %v (%d updated, %d deleted)\n",
+		len(rules), time.Since(start), updated, deleted)
+	return nil
 }
@@ -1,6 +1,6 @@
 //go:build ignore
 
-// Self-contained eBPF program for configurable TCP port filtering
+// Self-contained eBPF program for configurable TCP/UDP port and ICMP filtering
 // No external header dependencies
 
 #ifndef __KERNEL__
@@ -53,48 +53,325 @@ struct iphdr {
     __u32 daddr;
 } __attribute__((packed));
 
-struct tcphdr {
-    __u16 source;
-    __u16 dest;
-    __u32 seq;
-    __u32 ack_seq;
-    __u16 flags;  // Simplified
-    __u16 window;
-    __u16 check;
-    __u16 urg_ptr;
+// The first four bytes of a TCP or UDP header are the ports, of an ICMP
+// header the type and code, so one bounds check covers every protocol rules
+// can match on
+struct l4hdr {
+    union {
+        struct {
+            __u16 source;
+            __u16 dest;
+        };
+        struct {
+            __u8 type;
+            __u8 code;
+            __u16 check;
+        };
+    };
 } __attribute__((packed));
 
 // Constants
 #define ETH_P_IP 0x0800
+#define IPPROTO_ICMP 1
 #define IPPROTO_TCP 6
+#define IPPROTO_UDP 17
 
 // BPF map definitions
 enum bpf_map_type {
+    BPF_MAP_TYPE_HASH = 1,
     BPF_MAP_TYPE_ARRAY = 2,
+    BPF_MAP_TYPE_PERF_EVENT_ARRAY = 4,
+    BPF_MAP_TYPE_PERCPU_HASH = 5,
+    BPF_MAP_TYPE_PERCPU_ARRAY = 6,
+    BPF_MAP_TYPE_LRU_PERCPU_HASH = 10,
+    BPF_MAP_TYPE_RINGBUF = 27,
+    BPF_MAP_TYPE_BLOOM_FILTER = 30,
 };
 
+#define BPF_NOEXIST 1
+#define BPF_F_NO_PREALLOC 1
+
 #define __uint(name, val) int (*name)[val]
 #define __type(name, val) typeof(val) *name
 
-// Map to store the port to block (configurable at runtime)
+// Policies a rule belongs to. The enforcing policy decides the verdict, the
+// shadow policy is a candidate that is only counted.
+#define POLICY_ACTIVE (1 << 0)
+#define POLICY_SHADOW (1 << 1)
+
+// Rule key: IP protocol in the high 16 bits, then the destination port (host
+// byte order) for TCP/UDP or type << 8 | code for ICMP. An ICMP rule with
+// code ICMP_CODE_ANY matches every code of its type.
+#define RULE_KEY(proto, value) ((__u32)(proto) << 16 | (value))
+#define ICMP_CODE_ANY 0xff
+
+// Set of rules to block (configurable at runtime)
+// Key is a RULE_KEY, value is a POLICY_* bitmask
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 65536);
+    __type(key, __u32);
+    __type(value, __u8);
+} blocked_ports_map SEC(".maps");
+
+// Runtime configuration (key 0)
+#define MODE_ENFORCE 0
+#define MODE_MONITOR 1  // evaluate and count rules, but always pass
+
+#define CONFIG_F_SRC_BLOCKLIST (1 << 0)  // source blocklist is loaded
+#define CONFIG_F_EXPIRY        (1 << 1)  // some rules are temporary
+#define CONFIG_F_TALKERS_PASS  (1 << 2)  // count passed packets as talkers too
+
+struct filter_config {
+    __u32 mode;
+    __u32 sample_rate;  // sample 1 in N rule matches to userspace, 0 = off
+    __u32 flags;        // CONFIG_F_*
+};
+
 struct {
     __uint(type, BPF_MAP_TYPE_ARRAY);
     __uint(max_entries, 1);
     __type(key, __u32);
-    __type(value, __u16);
-} blocked_port_map SEC(".maps");
+    __type(value, struct filter_config);
+} config_map SEC(".maps");
+
+// Per-rule match counters for the active and shadow policy
+struct rule_hits {
+    __u64 active;
+    __u64 shadow;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 4096);
+    __type(key, __u32);
+    __type(value, struct rule_hits);
+} rule_hits_map SEC(".maps");
+
+// Would-be drops per policy (0: active, 1: shadow)
+struct policy_stats {
+    __u64 matches[2];
+    __u64 bytes[2];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct policy_stats);
+} policy_stats_map SEC(".maps");
+
+// Sampled rule matches
+struct match_sample {
+    __u32 saddr;
+    __u32 daddr;
+    __u16 sport;
+    __u16 dport;
+    __u8 policies;
+    __u8 verdict;
+    __u8 protocol;
+    __u8 pad;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} samples_map SEC(".maps");
+
+// Blocklisted IPv4 source addresses (network byte order). The bloom filter
+// is checked first so that the common, non-blocklisted packet never touches
+// the exact-match hash. Both are sized by the loader from the list length.
+struct {
+    __uint(type, BPF_MAP_TYPE_BLOOM_FILTER);
+    __uint(max_entries, 1);
+    __type(value, __u32);
+} src_bloom_map SEC(".maps");
+
+// Value is a POLICY_* bitmask
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 1);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, __u32);
+    __type(value, __u8);
+} blocked_src_map SEC(".maps");
+
+// Expiry of temporary rules, as bpf_ktime_get_ns() deadlines. Only
+// temporary rules have an entry; a rule without one is permanent. The source
+// map is sized by the loader like blocked_src_map.
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 65536);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, __u32);
+    __type(value, __u64);
+} port_expiry_map SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 1);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, __u32);
+    __type(value, __u64);
+} src_expiry_map SEC(".maps");
+
+// Top talkers: a Count-Min sketch of packets per (source, rule key) flow
+// plus a direct-mapped table of heavy-hitter candidates, both per CPU and
+// of fixed size however many flows there are. The loader sums the CPUs and
+// reports the candidates with the highest sketch estimates. The four row
+// indexes and the candidate slot are disjoint bit fields of one 64-bit
+// flow hash.
+#define CMS_DEPTH 4
+#define CMS_WIDTH_BITS 10
+#define CMS_WIDTH (1 << CMS_WIDTH_BITS)
+#define TALKER_SLOTS_BITS 8
+#define TALKER_SLOTS (1 << TALKER_SLOTS_BITS)
+
+struct talker_sketch {
+    __u32 counts[CMS_DEPTH][CMS_WIDTH];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct talker_sketch);
+} talker_sketch_map SEC(".maps");
+
+struct talker {
+    __u32 saddr;  // network byte order
+    __u32 rule;   // RULE_KEY
+    __u32 count;  // sketch estimate at the last update, decayed by collisions
+    __u32 pad;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, TALKER_SLOTS);
+    __type(key, __u32);
+    __type(value, struct talker);
+} talker_map SEC(".maps");
 
 // Map to store packet statistics
+#define STAT_TOTAL         0  // IPv4 packets evaluated against the blocklist and rules
+#define STAT_DROPPED       1  // packets dropped
+#define STAT_SRC_MATCHED   2  // packets from a blocklisted source
+#define STAT_BLOOM_FP      3  // bloom filter false positives
+#define STAT_EXPIRED       4  // temporary rules removed by a packet hitting them
+#define STAT_EXPIRED_SWEPT 5  // temporary rules removed by the loader's sweeper
+
 struct {
     __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(max_entries, 2);  // 0: total packets, 1: dropped packets
+    __uint(max_entries, 6);
     __type(key, __u32);
     __type(value, __u64);
 } stats_map SEC(".maps");
 
+// Per-RX-queue counters, used to spot RSS imbalance
+struct queue_key {
+    __u32 ifindex;
+    __u32 rx_queue;
+};
+
+struct queue_stats {
+    __u64 pass;
+    __u64 drop;
+    __u64 bytes;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, 1024);
+    __type(key, struct queue_key);
+    __type(value, struct queue_stats);
+} queue_stats_map SEC(".maps");
+
+// Per-verdict packet/byte counters and a log2 packet-size histogram.
+// Kept in one per-CPU slot so accounting costs a single lookup.
+#define VERDICT_PASS 0
+#define VERDICT_DROP 1
+#define SIZE_HIST_BUCKETS 16  // bucket i: [2^i, 2^(i+1)) bytes
+
+struct traffic_stats {
+    __u64 packets[2];
+    __u64 bytes[2];
+    __u64 size_hist[SIZE_HIST_BUCKETS];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct traffic_stats);
+} traffic_stats_map SEC(".maps");
+
 // BPF helper function declarations
 static void *(*bpf_map_lookup_elem)(void *map, void *key) = (void *) 1;
 static long (*bpf_map_update_elem)(void *map, void *key, void *value, __u64 flags) = (void *) 2;
+static long (*bpf_map_delete_elem)(void *map, void *key) = (void *) 3;
+static __u64 (*bpf_ktime_get_ns)(void) = (void *) 5;
+static __u32 (*bpf_get_prandom_u32)(void) = (void *) 7;
+static long (*bpf_ringbuf_output)(void *ringbuf, void *data, __u64 size, __u64 flags) = (void *) 130;
+static long (*bpf_map_peek_elem)(void *map, void *value) = (void *) 88;
+
+// Packet-trace mode, compiled in only with -DFILTER_TRACE. Records entry and
+// exit timestamps, the parse path taken and the verdict of every packet to a
+// per-CPU perf ring buffer. Without FILTER_TRACE the macros expand to nothing.
+enum trace_path {
+    TRACE_PATH_NON_IP = 0,    // truncated or non-IPv4 frame
+    TRACE_PATH_OTHER_PROTO,   // IPv4 but not (complete) TCP, UDP or ICMP
+    TRACE_PATH_NO_MATCH,      // L4 header parsed, no rule applies
+    TRACE_PATH_MATCH,         // rule applies, packet passes
+    TRACE_PATH_DROP,          // rule applies, packet dropped
+};
+
+#ifdef FILTER_TRACE
+#define BPF_F_CURRENT_CPU 0xffffffffULL
+
+struct trace_event {
+    __u64 start_ns;
+    __u64 end_ns;
+    __u32 path;
+    __u32 verdict;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u32));
+} trace_events SEC(".maps");
+
+static long (*bpf_trace_printk)(const char *fmt, __u32 fmt_size, ...) = (void *) 6;
+static long (*bpf_perf_event_output)(void *ctx, void *map, __u64 flags, void *data, __u64 size) = (void *) 25;
+
+#define bpf_printk(fmt, ...) ({                                  \
+    char ____fmt[] = fmt;                                        \
+    bpf_trace_printk(____fmt, sizeof(____fmt), ##__VA_ARGS__);   \
+})
+
+#define TRACE_PARAM , __u32 *trace_path
+#define TRACE_ARG , &trace_path
+#define TRACE_PATH(p) (*trace_path = (p))
+#define TRACE_BEGIN() \
+    __u64 trace_start = bpf_ktime_get_ns(); \
+    __u32 trace_path = TRACE_PATH_NON_IP
+#define TRACE_END(ctx, action) ({                                \
+    struct trace_event ev = {                                    \
+        .start_ns = trace_start,                                 \
+        .end_ns = bpf_ktime_get_ns(),                            \
+        .path = trace_path,                                      \
+        .verdict = (action),                                     \
+    };                                                           \
+    bpf_perf_event_output(ctx, &trace_events, BPF_F_CURRENT_CPU, \
+                          &ev, sizeof(ev));                      \
+})
+#else
+#define TRACE_PARAM
+#define TRACE_ARG
+#define TRACE_PATH(p) ((void)0)
+#define TRACE_BEGIN() do {} while (0)
+#define TRACE_END(ctx, action) do {} while (0)
+#endif
 
 // Helper functions
 static __always_inline __u16 bpf_ntohs(__u16 netshort) {
@@ -106,12 +383,211 @@ static __always_inline void atomic_add(__u64 *ptr, __u64 val) {
     __sync_fetch_and_add(ptr, val);
 }
 
-SEC("xdp")
-int tcp_port_filter(struct xdp_md *ctx)
+// Branch-free floor(log2(v)) for v > 0
+static __always_inline __u32 log2_u32(__u32 v) {
+    __u32 r, shift;
+
+    r = (v > 0xFFFF) << 4; v >>= r;
+    shift = (v > 0xFF) << 3; v >>= shift; r |= shift;
+    shift = (v > 0xF) << 2; v >>= shift; r |= shift;
+    shift = (v > 0x3) << 1; v >>= shift; r |= shift;
+    return r | (v >> 1);
+}
+
+// Account packets, bytes and packet size for the verdict
+static __always_inline void account_traffic(int action, __u64 bytes) {
+    __u32 key = 0;
+    struct traffic_stats *ts = bpf_map_lookup_elem(&traffic_stats_map, &key);
+    if (!ts)
+        return;
+
+    __u32 verdict = action == XDP_DROP ? VERDICT_DROP : VERDICT_PASS;
+    ts->packets[verdict]++;
+    ts->bytes[verdict] += bytes;
+
+    __u32 bucket = log2_u32(bytes | 1);
+    if (bucket >= SIZE_HIST_BUCKETS)
+        bucket = SIZE_HIST_BUCKETS - 1;
+    ts->size_hist[bucket]++;
+}
+
+// Account the verdict against the (ifindex, rx_queue) the packet arrived on.
+// The map is per-CPU, so no atomics are needed.
+static __always_inline void account_queue(struct xdp_md *ctx, int action, __u64 bytes) {
+    struct queue_key qk = {
+        .ifindex = ctx->ingress_ifindex,
+        .rx_queue = ctx->rx_queue_index,
+    };
+
+    struct queue_stats *qs = bpf_map_lookup_elem(&queue_stats_map, &qk);
+    if (!qs) {
+        struct queue_stats init = {};
+        bpf_map_update_elem(&queue_stats_map, &qk, &init, BPF_NOEXIST);
+        qs = bpf_map_lookup_elem(&queue_stats_map, &qk);
+        if (!qs)
+            return;
+    }
+
+    if (action == XDP_DROP)
+        qs->drop++;
+    else
+        qs->pass++;
+    qs->bytes += bytes;
+}
+
+static __always_inline void count(__u32 slot) {
+    __u64 *counter = bpf_map_lookup_elem(&stats_map, &slot);
+    if (counter)
+        atomic_add(counter, 1);
+}
+
+// Count a would-be drop against every policy in the bitmask
+static __always_inline void count_policies(__u8 policies, __u64 bytes) {
+    __u32 key = 0;
+    struct policy_stats *ps = bpf_map_lookup_elem(&policy_stats_map, &key);
+    if (!ps)
+        return;
+
+    if (policies & POLICY_ACTIVE) {
+        ps->matches[0]++;
+        ps->bytes[0] += bytes;
+    }
+    if (policies & POLICY_SHADOW) {
+        ps->matches[1]++;
+        ps->bytes[1] += bytes;
+    }
+}
+
+// splitmix64 finalizer, mirrored by the loader
+static __always_inline __u64 mix64(__u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Count a packet of the flow in the sketch, then offer the flow to its
+// candidate slot. A slot held by another flow is taken over once the new
+// flow's estimate exceeds its count; every losing collision decays that
+// count, so a flow that went quiet eventually gives its slot up.
+static __always_inline void count_talker(__u32 saddr, __u32 rule) {
+    __u32 key = 0;
+    struct talker_sketch *sk = bpf_map_lookup_elem(&talker_sketch_map, &key);
+    if (!sk)
+        return;
+
+    __u64 h = mix64((__u64)saddr << 32 | rule);
+    __u32 est = ~0U;
+#pragma unroll
+    for (int i = 0; i < CMS_DEPTH; i++) {
+        __u32 *c = &sk->counts[i][(h >> (i * CMS_WIDTH_BITS)) & (CMS_WIDTH - 1)];
+        *c += 1;
+        if (*c < est)
+            est = *c;
+    }
+
+    __u32 slot = (h >> (CMS_DEPTH * CMS_WIDTH_BITS)) & (TALKER_SLOTS - 1);
+    struct talker *t = bpf_map_lookup_elem(&talker_map, &slot);
+    if (!t)
+        return;
+    if (t->saddr == saddr && t->rule == rule) {
+        t->count = est;
+    } else if (est > t->count) {
+        t->saddr = saddr;
+        t->rule = rule;
+        t->count = est;
+    } else {
+        t->count--;
+    }
+}
+
+// Returns the policies of a rule that are still in effect. "block" only
+// sets POLICY_ACTIVE, so a temporary rule past its deadline loses that bit
+// and keeps any shadow membership. The first packet to see the deadline
+// clears the bit, deleting the rule if nothing else holds it, and counts
+// the expiration; rules that see no traffic are left to the loader's
+// sweeper.
+static __always_inline __u8 unexpired_policies(void *expiry_map, void *rule_map, void *key,
+                                               __u8 *policies) {
+    __u8 cur = *policies;
+    __u64 *expires = bpf_map_lookup_elem(expiry_map, key);
+    if (!expires || bpf_ktime_get_ns() < *expires)
+        return cur;
+
+    __u8 rest = cur & ~POLICY_ACTIVE;
+    if (bpf_map_delete_elem(expiry_map, key) == 0) {
+        if (rest)
+            *policies = rest;
+        else
+            bpf_map_delete_elem(rule_map, key);
+        count(STAT_EXPIRED);
+    }
+    return rest;
+}
+
+// Returns the POLICY_* bitmask of a blocklisted source, 0 if not listed
+static __always_inline __u8 lookup_src_blocklist(__u32 saddr, __u32 flags) {
+    if (bpf_map_peek_elem(&src_bloom_map, &saddr) != 0)
+        return 0;  // definitely not listed
+
+    __u8 *policies = bpf_map_lookup_elem(&blocked_src_map, &saddr);
+    if (!policies) {
+        count(STAT_BLOOM_FP);
+        return 0;
+    }
+    if (flags & CONFIG_F_EXPIRY)
+        return unexpired_policies(&src_expiry_map, &blocked_src_map, &saddr, policies);
+    return *policies;
+}
+
+// Count a rule match against every policy the rule belongs to and sample
+// it to userspace if configured
+static __always_inline void record_match(struct iphdr *ip, __u16 sport, __u32 rule,
+                                         __u8 policies, int verdict, __u64 bytes,
+                                         struct filter_config *cfg) {
+    struct rule_hits *hits = bpf_map_lookup_elem(&rule_hits_map, &rule);
+    if (!hits) {
+        struct rule_hits init = {};
+        bpf_map_update_elem(&rule_hits_map, &rule, &init, BPF_NOEXIST);
+        hits = bpf_map_lookup_elem(&rule_hits_map, &rule);
+    }
+
+    if (hits) {
+        if (policies & POLICY_ACTIVE)
+            hits->active++;
+        if (policies & POLICY_SHADOW)
+            hits->shadow++;
+    }
+    count_policies(policies, bytes);
+
+    if (cfg && cfg->sample_rate && bpf_get_prandom_u32() % cfg->sample_rate == 0) {
+        struct match_sample sample = {
+            .saddr = ip->saddr,
+            .daddr = ip->daddr,
+            .sport = sport,
+            .dport = rule & 0xffff,
+            .policies = policies,
+            .verdict = verdict,
+            .protocol = rule >> 16,
+        };
+        bpf_ringbuf_output(&samples_map, &sample, sizeof(sample), 0);
+    }
+}
+
+// The flow a packet belongs to, for the top-talkers sketch. rule stays 0
+// until the L4 header has been parsed, and is RULE_SRC_BLOCKLIST for drops
+// of blocklisted sources, which happen before that.
+#define RULE_SRC_BLOCKLIST 0xffffffff
+
+struct flow_key {
+    __u32 saddr;
+    __u32 rule;
+};
+
+static __always_inline int filter_packet(void *data, void *data_end, struct filter_config *cfg,
+                                         struct flow_key *flow TRACE_PARAM)
 {
-    void *data_end = (void *)(long)ctx->data_end;
-    void *data = (void *)(long)ctx->data;
-    
     // Parse Ethernet header
     struct ethhdr *eth = data;
     if ((void *)(eth + 1) > data_end)
@@ -126,39 +602,105 @@ int tcp_port_filter(struct xdp_md *ctx)
     if ((void *)(ip + 1) > data_end)
         return XDP_PASS;
 
-    // Only process TCP packets
-    if (ip->protocol != IPPROTO_TCP)
+    int monitor = cfg && cfg->mode == MODE_MONITOR;
+
+    // Update total packet counter
+    count(STAT_TOTAL);
+
+    // Drop blocklisted sources
+    if (cfg && (cfg->flags & CONFIG_F_SRC_BLOCKLIST)) {
+        __u8 src_policies = lookup_src_blocklist(ip->saddr, cfg->flags);
+        if (src_policies) {
+            count(STAT_SRC_MATCHED);
+            count_policies(src_policies, data_end - data);
+            if ((src_policies & POLICY_ACTIVE) && !monitor) {
+                TRACE_PATH(TRACE_PATH_DROP);
+                count(STAT_DROPPED);
+                flow->saddr = ip->saddr;
+                flow->rule = RULE_SRC_BLOCKLIST;
+                return XDP_DROP;
+            }
+        }
+    }
+
+    // Parse the ports or ICMP type/code, then build the rule key with a
+    // single protocol dispatch
+    TRACE_PATH(TRACE_PATH_OTHER_PROTO);
+    struct l4hdr *l4 = (void *)ip + sizeof(struct iphdr);
+    if ((void *)(l4 + 1) > data_end)
         return XDP_PASS;
 
-    // Parse TCP header
-    struct tcphdr *tcp = (void *)ip + sizeof(struct iphdr);
-    if ((void *)(tcp + 1) > data_end)
+    __u32 rule;
+    __u16 sport = 0;
+    switch (ip->protocol) {
+    case IPPROTO_TCP:
+    case IPPROTO_UDP:
+        rule = RULE_KEY(ip->protocol, bpf_ntohs(l4->dest));
+        sport = bpf_ntohs(l4->source);
+        break;
+    case IPPROTO_ICMP:
+        rule = RULE_KEY(IPPROTO_ICMP, l4->type << 8 | l4->code);
+        break;
+    default:
         return XDP_PASS;
+    }
+    flow->saddr = ip->saddr;
+    flow->rule = rule;
+    TRACE_PATH(TRACE_PATH_NO_MATCH);
 
-    // Get the configured port to block (default: 4040)
-    __u32 key = 0;
-    __u16 *blocked_port = bpf_map_lookup_elem(&blocked_port_map, &key);
-    __u16 target_port = blocked_port ? *blocked_port : 4040;
+    // Look up the rule in both the enforcing and the shadow policy. ICMP
+    // falls back to the any-code rule of the type.
+    __u8 *policies = bpf_map_lookup_elem(&blocked_ports_map, &rule);
+    if (!policies && ip->protocol == IPPROTO_ICMP) {
+        rule |= ICMP_CODE_ANY;
+        policies = bpf_map_lookup_elem(&blocked_ports_map, &rule);
+    }
+    if (!policies)
+        return XDP_PASS;
+    __u8 rule_policies = *policies;
+    if (cfg && (cfg->flags & CONFIG_F_EXPIRY))
+        rule_policies = unexpired_policies(&port_expiry_map, &blocked_ports_map, &rule, policies);
+    if (!rule_policies)
+        return XDP_PASS;
 
-    __u16 dest_port = bpf_ntohs(tcp->dest);
-    
-    // Update total packet counter
-    __u64 *total_count = bpf_map_lookup_elem(&stats_map, &key);
-    if (total_count)
-        atomic_add(total_count, 1);
+    int verdict = XDP_PASS;
+    if ((rule_policies & POLICY_ACTIVE) && !monitor)
+        verdict = XDP_DROP;
+
+    record_match(ip, sport, rule, rule_policies, verdict, data_end - data, cfg);
+    TRACE_PATH(verdict == XDP_DROP ? TRACE_PATH_DROP : TRACE_PATH_MATCH);
 
     // Check if this packet should be dropped
-    if (dest_port == target_port) {
+    if (verdict == XDP_DROP) {
         // Update dropped packet counter
-        key = 1;
-        __u64 *dropped_count = bpf_map_lookup_elem(&stats_map, &key);
-        if (dropped_count)
-            atomic_add(dropped_count, 1);
-        
+        count(STAT_DROPPED);
+
         return XDP_DROP;  // Block the packet
     }
 
     return XDP_PASS;  // Allow the packet
 }
 
+SEC("xdp")
+int tcp_port_filter(struct xdp_md *ctx)
+{
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    TRACE_BEGIN();
+
+    __u32 key = 0;
+    struct filter_config *cfg = bpf_map_lookup_elem(&config_map, &key);
+    struct flow_key flow = {};
+
+    __u64 bytes = data_end - data;
+    int action = filter_packet(data, data_end, cfg, &flow TRACE_ARG);
+    account_traffic(action, bytes);
+    account_queue(ctx, action, bytes);
+    if (flow.rule && (action == XDP_DROP || (cfg && (cfg->flags & CONFIG_F_TALKERS_PASS))))
+        count_talker(flow.saddr, flow.rule);
+
+    TRACE_END(ctx, action);
+    return action;
+}
+
 char _license[] SEC("license") = "GPL";
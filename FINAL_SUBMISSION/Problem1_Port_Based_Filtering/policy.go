@@ -0,0 +1,248 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"log"
+	"net"
+	"sort"
+	"time"
+	"unsafe"
+
+	"filter-common/traffic"
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/ringbuf"
+)
+
+// Policy membership bits and filter modes, as in the eBPF program.
+const (
+	policyActive = 1 << 0
+	policyShadow = 1 << 1
+
+	modeEnforce = 0
+	modeMonitor = 1
+)
+
+// xdpDrop is XDP_DROP in enum xdp_action, the verdict samples carry.
+const xdpDrop = 1
+
+// filterConfig mirrors struct filter_config in the eBPF program.
+type filterConfig struct {
+	Mode       uint32
+	SampleRate uint32
+	Flags      uint32
+}
+
+// ruleHits mirrors struct rule_hits in the eBPF program.
+type ruleHits struct {
+	Active uint64
+	Shadow uint64
+}
+
+// policyStats mirrors struct policy_stats in the eBPF program.
+type policyStats struct {
+	Matches [2]uint64
+	Bytes   [2]uint64
+}
+
+// matchSample mirrors struct match_sample in the eBPF program.
+type matchSample struct {
+	Saddr    [4]byte
+	Daddr    [4]byte
+	Sport    uint16
+	Dport    uint16
+	Policies uint8
+	Verdict  uint8
+	Protocol uint8
+	Pad      uint8
+}
+
+var nativeEndian binary.ByteOrder = func() binary.ByteOrder {
+	x := uint16(1)
+	if *(*byte)(unsafe.Pointer(&x)) == 1 {
+		return binary.LittleEndian
+	}
+	return binary.BigEndian
+}()
+
+// policySources names the enforcing and shadow rule sets. Each is either a
+// rule list or a rules file, and is re-read on reload.
+type policySources struct {
+	active string
+	shadow string
+}
+
+// load compiles both rule sets into blocked_ports_map contents, tagging
+// each rule with the policies it belongs to.
+func (ps policySources) load() (map[ruleKey]uint8, error) {
+	rules := make(map[ruleKey]uint8)
+	for _, p := range []struct {
+		src string
+		bit uint8
+	}{{ps.active, policyActive}, {ps.shadow, policyShadow}} {
+		if p.src == "" {
+			continue
+		}
+		set, err := loadRuleSource(p.src)
+		if err != nil {
+			return nil, err
+		}
+		for rule := range set {
+			rules[rule] |= p.bit
+		}
+	}
+	return rules, nil
+}
+
+func readPolicyStats(m *ebpf.Map) (policyStats, error) {
+	var (
+		perCPU []policyStats
+		sum    policyStats
+	)
+	if err := m.Lookup(uint32(0), &perCPU); err != nil {
+		return sum, err
+	}
+	for _, s := range perCPU {
+		for i := range sum.Matches {
+			sum.Matches[i] += s.Matches[i]
+			sum.Bytes[i] += s.Bytes[i]
+		}
+	}
+	return sum, nil
+}
+
+func readRuleHits(m *ebpf.Map) (map[ruleKey]ruleHits, error) {
+	var (
+		rule   ruleKey
+		perCPU []ruleHits
+		hits   = make(map[ruleKey]ruleHits)
+	)
+	iter := m.Iterate()
+	for iter.Next(&rule, &perCPU) {
+		var sum ruleHits
+		for _, h := range perCPU {
+			sum.Active += h.Active
+			sum.Shadow += h.Shadow
+		}
+		hits[rule] = sum
+	}
+	return hits, iter.Err()
+}
+
+// policyReporter diffs the active and shadow policy counters.
+type policyReporter struct {
+	statsMap *ebpf.Map
+	hitsMap  *ebpf.Map
+	prev     policyStats
+	prevHits map[ruleKey]ruleHits
+}
+
+// newPolicyReporter reads the current counters first, so that the first
+// report covers one interval rather than the lifetime of the maps.
+func newPolicyReporter(statsMap, hitsMap *ebpf.Map) *policyReporter {
+	pr := &policyReporter{statsMap: statsMap, hitsMap: hitsMap}
+	pr.prev, _ = readPolicyStats(statsMap)
+	pr.prevHits, _ = readRuleHits(hitsMap)
+	return pr
+}
+
+// print shows would-be drop rates of both policies over the last interval
+// and the rules busiest over that interval that only one of the two
+// policies contains, or that neither contains any more.
+func (pr *policyReporter) print(rules map[ruleKey]uint8, interval time.Duration) {
+	cur, err := readPolicyStats(pr.statsMap)
+	if err != nil {
+		log.Printf("Failed to read policy statistics: %v", err)
+		return
+	}
+	secs := interval.Seconds()
+	rate := func(i int) (float64, float64) {
+		return float64(cur.Matches[i]-pr.prev.Matches[i]) / secs,
+			float64(cur.Bytes[i]-pr.prev.Bytes[i]) / secs
+	}
+	activePPS, activeBPS := rate(0)
+	shadowPPS, shadowBPS := rate(1)
+	pr.prev = cur
+	fmt.Printf("🔍 Policy: active would drop %.0f pps / %s | shadow would drop %.0f pps / %s | Δ %+.0f pps\n",
+		activePPS, traffic.FormatBitRate(activeBPS), shadowPPS, traffic.FormatBitRate(shadowBPS), shadowPPS-activePPS)
+
+	hits, err := readRuleHits(pr.hitsMap)
+	if err != nil {
+		log.Printf("Failed to read rule hits: %v", err)
+		return
+	}
+	delta := make(map[ruleKey]ruleHits, len(hits))
+	var diff []ruleKey
+	for rule, h := range hits {
+		// A rule deleted and added again restarts its counters
+		if prev, ok := pr.prevHits[rule]; ok && h.Active >= prev.Active && h.Shadow >= prev.Shadow {
+			h.Active -= prev.Active
+			h.Shadow -= prev.Shadow
+		}
+		delta[rule] = h
+		if rules[rule] != policyActive|policyShadow && h.Active+h.Shadow > 0 {
+			diff = append(diff, rule)
+		}
+	}
+	pr.prevHits = hits
+	sort.Slice(diff, func(i, j int) bool {
+		hi, hj := delta[diff[i]], delta[diff[j]]
+		return hi.Active+hi.Shadow > hj.Active+hj.Shadow
+	})
+	if len(diff) > 10 {
+		diff = diff[:10]
+	}
+	for _, rule := range diff {
+		var which string
+		switch rules[rule] {
+		case policyActive:
+			which = "active only"
+		case policyShadow:
+			which = "shadow only"
+		default:
+			which = "removed"
+		}
+		fmt.Printf("   %-12s active=%-10d shadow=%-10d [%s]\n",
+			rule, delta[rule].Active, delta[rule].Shadow, which)
+	}
+}
+
+// readSamples prints sampled rule matches until the reader is closed.
+func readSamples(rd *ringbuf.Reader) {
+	for {
+		rec, err := rd.Read()
+		if errors.Is(err, ringbuf.ErrClosed) {
+			return
+		}
+		if err != nil {
+			log.Printf("Failed to read sample: %v", err)
+			continue
+		}
+		var s matchSample
+		if err := binary.Read(bytes.NewReader(rec.RawSample), nativeEndian, &s); err != nil {
+			log.Printf("Failed to decode sample: %v", err)
+			continue
+		}
+		verdict := "pass"
+		if s.Verdict == xdpDrop {
+			verdict = "drop"
+		}
+		fmt.Printf("🔎 %s:%d -> %s %s policies=%s verdict=%s\n",
+			net.IP(s.Saddr[:]), s.Sport, net.IP(s.Daddr[:]), newRuleKey(s.Protocol, s.Dport),
+			policyNames(s.Policies), verdict)
+	}
+}
+
+func policyNames(bits uint8) string {
+	switch bits & (policyActive | policyShadow) {
+	case policyActive:
+		return "active"
+	case policyShadow:
+		return "shadow"
+	case policyActive | policyShadow:
+		return "active,shadow"
+	}
+	return "none"
+}
@@ -0,0 +1,143 @@
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"os"
+	"strconv"
+	"strings"
+)
+
+// IP protocols rules can match on, as in the eBPF program.
+const (
+	protoICMP = 1
+	protoTCP  = 6
+	protoUDP  = 17
+)
+
+// icmpCodeAny is the ICMP code of a rule that matches every code of its
+// type, as ICMP_CODE_ANY.
+const icmpCodeAny = 0xff
+
+// ruleKey mirrors RULE_KEY in the eBPF program: the IP protocol in the high
+// 16 bits, then the destination port for TCP/UDP or type<<8|code for ICMP.
+type ruleKey uint32
+
+// ruleSrcBlocklist is the rule of a top-talkers flow dropped by the source
+// blocklist, as RULE_SRC_BLOCKLIST.
+const ruleSrcBlocklist ruleKey = 0xffffffff
+
+func newRuleKey(proto uint8, value uint16) ruleKey {
+	return ruleKey(uint32(proto)<<16 | uint32(value))
+}
+
+func (k ruleKey) proto() uint8 { return uint8(k >> 16) }
+
+func (k ruleKey) String() string {
+	if k == ruleSrcBlocklist {
+		return "blocklist"
+	}
+	switch k.proto() {
+	case protoTCP:
+		return fmt.Sprintf("tcp/%d", uint16(k))
+	case protoUDP:
+		return fmt.Sprintf("udp/%d", uint16(k))
+	case protoICMP:
+		if uint8(k) == icmpCodeAny {
+			return fmt.Sprintf("icmp/%d", uint8(k>>8))
+		}
+		return fmt.Sprintf("icmp/%d/%d", uint8(k>>8), uint8(k))
+	}
+	return fmt.Sprintf("proto%d/%d", k.proto(), uint16(k))
+}
+
+// parsePort validates a TCP or UDP port given on the command line or in a
+// rules file.
+func parsePort(s string) (uint16, error) {
+	port, err := strconv.Atoi(strings.TrimSpace(s))
+	if err != nil || port < 1 || port > 65535 {
+		return 0, fmt.Errorf("invalid port %q", s)
+	}
+	return uint16(port), nil
+}
+
+// parseRule parses a rule: "tcp/4040", "udp/53", "icmp/8" (any code) or
+// "icmp/3/4". A bare port is a TCP rule, as before UDP and ICMP support.
+func parseRule(s string) (ruleKey, error) {
+	proto, arg, ok := strings.Cut(strings.TrimSpace(s), "/")
+	if !ok {
+		proto, arg = "tcp", proto
+	}
+	switch strings.ToLower(proto) {
+	case "tcp", "udp":
+		port, err := parsePort(arg)
+		if err != nil {
+			return 0, err
+		}
+		if strings.ToLower(proto) == "udp" {
+			return newRuleKey(protoUDP, port), nil
+		}
+		return newRuleKey(protoTCP, port), nil
+	case "icmp":
+		typ, code, hasCode := strings.Cut(arg, "/")
+		t, err := strconv.ParseUint(typ, 10, 8)
+		if err != nil {
+			return 0, fmt.Errorf("invalid ICMP type %q", typ)
+		}
+		c := uint64(icmpCodeAny)
+		if hasCode {
+			if c, err = strconv.ParseUint(code, 10, 8); err != nil || c == icmpCodeAny {
+				return 0, fmt.Errorf("invalid ICMP code %q", code)
+			}
+		}
+		return newRuleKey(protoICMP, uint16(t<<8|c)), nil
+	}
+	return 0, fmt.Errorf("invalid rule %q (want tcp/PORT, udp/PORT or icmp/TYPE[/CODE])", s)
+}
+
+// loadRuleSource reads a rule list ("4040,udp/53") or a rules file.
+func loadRuleSource(src string) (map[ruleKey]uint8, error) {
+	if _, err := os.Stat(src); err == nil {
+		return loadRulesFile(src)
+	}
+	return parseRuleList(src)
+}
+
+// parseRuleList parses a comma separated list of rules, e.g.
+// "4040,udp/53,icmp/8".
+func parseRuleList(s string) (map[ruleKey]uint8, error) {
+	rules := make(map[ruleKey]uint8)
+	for _, field := range strings.Split(s, ",") {
+		rule, err := parseRule(field)
+		if err != nil {
+			return nil, err
+		}
+		rules[rule] = 1
+	}
+	return rules, nil
+}
+
+// loadRulesFile reads a rules file with one rule per line. Blank lines and
+// lines starting with '#' are ignored.
+func loadRulesFile(path string) (map[ruleKey]uint8, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	rules := make(map[ruleKey]uint8)
+	scanner := bufio.NewScanner(f)
+	for line := 1; scanner.Scan(); line++ {
+		text := strings.TrimSpace(scanner.Text())
+		if text == "" || strings.HasPrefix(text, "#") {
+			continue
+		}
+		rule, err := parseRule(text)
+		if err != nil {
+			return nil, fmt.Errorf("%s:%d: %w", path, line, err)
+		}
+		rules[rule] = 1
+	}
+	return rules, scanner.Err()
+}
@@ -0,0 +1,86 @@
+package main
+
+import "testing"
+
+func TestParseRule(t *testing.T) {
+	tests := []struct {
+		in   string
+		want ruleKey
+		str  string
+	}{
+		{"4040", 6<<16 | 4040, "tcp/4040"},
+		{" tcp/80 ", 6<<16 | 80, "tcp/80"},
+		{"TCP/443", 6<<16 | 443, "tcp/443"},
+		{"udp/53", 17<<16 | 53, "udp/53"},
+		{"udp/65535", 17<<16 | 65535, "udp/65535"},
+		{"icmp/8", 1<<16 | 8<<8 | 0xff, "icmp/8"},
+		{"icmp/3/3", 1<<16 | 3<<8 | 3, "icmp/3/3"},
+		{"icmp/0/0", 1<<16 | 0, "icmp/0/0"},
+		{"icmp/255/254", 1<<16 | 255<<8 | 254, "icmp/255/254"},
+	}
+	for _, tt := range tests {
+		got, err := parseRule(tt.in)
+		if err != nil {
+			t.Errorf("parseRule(%q): %v", tt.in, err)
+			continue
+		}
+		if got != tt.want {
+			t.Errorf("parseRule(%q) = %#x, want %#x", tt.in, uint32(got), uint32(tt.want))
+		}
+		if got.String() != tt.str {
+			t.Errorf("parseRule(%q).String() = %q, want %q", tt.in, got.String(), tt.str)
+		}
+		// String is the canonical form and parses back to the same key
+		if again, err := parseRule(got.String()); err != nil || again != got {
+			t.Errorf("parseRule(%q) = %#x, %v; want %#x", got.String(), uint32(again), err, uint32(got))
+		}
+	}
+}
+
+func TestParseRuleInvalid(t *testing.T) {
+	for _, in := range []string{
+		"", "0", "65536", "-1", "tcp/", "tcp/0", "udp/70000", "sctp/80",
+		"icmp/", "icmp/256", "icmp/8/256", "icmp/8/255", "icmp/x",
+	} {
+		if got, err := parseRule(in); err == nil {
+			t.Errorf("parseRule(%q) = %v, want error", in, got)
+		}
+	}
+}
+
+func TestRuleKeyProto(t *testing.T) {
+	for _, proto := range []uint8{protoICMP, protoTCP, protoUDP} {
+		k := newRuleKey(proto, 0xffff)
+		if k.proto() != proto {
+			t.Errorf("newRuleKey(%d, 0xffff).proto() = %d", proto, k.proto())
+		}
+		if uint16(k) != 0xffff {
+			t.Errorf("newRuleKey(%d, 0xffff) value = %#x", proto, uint16(k))
+		}
+	}
+}
+
+func TestRuleSrcBlocklist(t *testing.T) {
+	if got := ruleSrcBlocklist.String(); got != "blocklist" {
+		t.Errorf("ruleSrcBlocklist.String() = %q", got)
+	}
+}
+
+func TestParseRuleList(t *testing.T) {
+	rules, err := parseRuleList("4040,udp/53,icmp/8,tcp/4040")
+	if err != nil {
+		t.Fatal(err)
+	}
+	want := []ruleKey{newRuleKey(protoTCP, 4040), newRuleKey(protoUDP, 53), newRuleKey(protoICMP, 8<<8|icmpCodeAny)}
+	if len(rules) != len(want) {
+		t.Errorf("parseRuleList: %d rules, want %d", len(rules), len(want))
+	}
+	for _, k := range want {
+		if _, ok := rules[k]; !ok {
+			t.Errorf("parseRuleList: missing %v", k)
+		}
+	}
+	if _, err := parseRuleList("4040,,53"); err == nil {
+		t.Errorf("parseRuleList with an empty rule: want error")
+	}
+}
@@ -0,0 +1,12 @@
+package main
+
+// stats_map slots, as in the eBPF program.
+const (
+	statTotal        = 0
+	statDropped      = 1
+	statSrcMatched   = 2
+	statBloomFP      = 3
+	statExpired      = 4
+	statExpiredSwept = 5
+	statSlots        = 6
+)
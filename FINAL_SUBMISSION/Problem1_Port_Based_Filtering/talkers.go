@@ -0,0 +1,165 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"net"
+	"sort"
+	"time"
+
+	"github.com/cilium/ebpf"
+)
+
+// configFlagTalkersPass counts passed packets as talkers too, as
+// CONFIG_F_TALKERS_PASS.
+const configFlagTalkersPass = 1 << 2
+
+// Sketch and candidate table dimensions, as in the eBPF program.
+const (
+	cmsDepth     = 4
+	cmsWidthBits = 10
+	cmsWidth     = 1 << cmsWidthBits
+)
+
+// topTalkersN is how many heavy hitters each report shows.
+const topTalkersN = 10
+
+// talkerSketch mirrors struct talker_sketch in the eBPF program.
+type talkerSketch [cmsDepth][cmsWidth]uint32
+
+// talker mirrors struct talker in the eBPF program.
+type talker struct {
+	Saddr ipv4Key
+	Rule  ruleKey
+	Count uint32
+	Pad   uint32
+}
+
+// flowKey identifies a talker: a source and the rule key it sends to.
+type flowKey struct {
+	saddr ipv4Key
+	rule  ruleKey
+}
+
+// mix64 is the splitmix64 finalizer, as in the eBPF program.
+func mix64(x uint64) uint64 {
+	x ^= x >> 30
+	x *= 0xbf58476d1ce4e5b9
+	x ^= x >> 27
+	x *= 0x94d049bb133111eb
+	return x ^ (x >> 31)
+}
+
+// estimate returns the Count-Min estimate of a flow: the smallest of its
+// counters, one per row. The program hashes the address as loaded from
+// the packet, hence the native-endian read.
+func (s *talkerSketch) estimate(f flowKey) uint32 {
+	h := mix64(uint64(nativeEndian.Uint32(f.saddr[:]))<<32 | uint64(f.rule))
+	est := ^uint32(0)
+	for i := range s {
+		if c := s[i][(h>>(i*cmsWidthBits))&(cmsWidth-1)]; c < est {
+			est = c
+		}
+	}
+	return est
+}
+
+// readTalkerSketch returns the sketch summed over all CPUs. Count-Min
+// sketches are linear, so the sum is the sketch of all traffic.
+func readTalkerSketch(m *ebpf.Map) (*talkerSketch, error) {
+	var (
+		perCPU []talkerSketch
+		sum    talkerSketch
+	)
+	if err := m.Lookup(uint32(0), &perCPU); err != nil {
+		return nil, err
+	}
+	for c := range perCPU {
+		for i := range sum {
+			for j := range sum[i] {
+				sum[i][j] += perCPU[c][i][j]
+			}
+		}
+	}
+	return &sum, nil
+}
+
+// readTalkerCandidates returns the union of every CPU's candidate table.
+func readTalkerCandidates(m *ebpf.Map) (map[flowKey]struct{}, error) {
+	var (
+		slot   uint32
+		perCPU []talker
+		flows  = make(map[flowKey]struct{})
+	)
+	iter := m.Iterate()
+	for iter.Next(&slot, &perCPU) {
+		for _, t := range perCPU {
+			if t.Rule != 0 {
+				flows[flowKey{t.Saddr, t.Rule}] = struct{}{}
+			}
+		}
+	}
+	return flows, iter.Err()
+}
+
+// talkerReporter keeps the previous merged sketch so that each tick
+// reports the heavy hitters of the last interval only.
+type talkerReporter struct {
+	sketchMap *ebpf.Map
+	talkerMap *ebpf.Map
+	prev      *talkerSketch
+}
+
+func newTalkerReporter(sketchMap, talkerMap *ebpf.Map) *talkerReporter {
+	tr := &talkerReporter{sketchMap: sketchMap, talkerMap: talkerMap, prev: &talkerSketch{}}
+	if sketch, err := readTalkerSketch(sketchMap); err == nil {
+		tr.prev = sketch
+	}
+	return tr
+}
+
+// print shows the topTalkersN flows by estimated packet rate over the last
+// interval. Estimates never undercount; collisions can only inflate them.
+func (tr *talkerReporter) print(interval time.Duration) {
+	cur, err := readTalkerSketch(tr.sketchMap)
+	if err != nil {
+		log.Printf("Failed to read talker sketch: %v", err)
+		return
+	}
+	var delta talkerSketch
+	for i := range delta {
+		for j := range delta[i] {
+			delta[i][j] = cur[i][j] - tr.prev[i][j]
+		}
+	}
+	tr.prev = cur
+
+	flows, err := readTalkerCandidates(tr.talkerMap)
+	if err != nil {
+		log.Printf("Failed to read talker candidates: %v", err)
+		return
+	}
+	type heavyHitter struct {
+		flowKey
+		packets uint32
+	}
+	var top []heavyHitter
+	for f := range flows {
+		if n := delta.estimate(f); n > 0 {
+			top = append(top, heavyHitter{f, n})
+		}
+	}
+	if len(top) == 0 {
+		return
+	}
+	sort.Slice(top, func(i, j int) bool { return top[i].packets > top[j].packets })
+	if len(top) > topTalkersN {
+		top = top[:topTalkersN]
+	}
+
+	fmt.Printf("🗣️  Top talkers over %v (%d candidates):\n", interval, len(flows))
+	for _, t := range top {
+		fmt.Printf("   %-15s -> %-12s ≈%10.0f pps\n",
+			net.IP(t.saddr[:]), t.rule, float64(t.packets)/interval.Seconds())
+	}
+}
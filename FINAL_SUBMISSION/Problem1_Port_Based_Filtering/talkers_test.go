@@ -0,0 +1,55 @@
+package main
+
+import (
+	"encoding/binary"
+	"testing"
+)
+
+// The vectors below come from mix64 and count_talker in packet_filter.c,
+// compiled for a little-endian host.
+
+func TestMix64(t *testing.T) {
+	tests := []struct{ in, want uint64 }{
+		{0, 0},
+		{1, 0x5692161d100b05e5},
+		{0xdeadbeef, 0x4e062702ec929eea},
+		{0x7f00000100060fc8, 0xe5fd7b10d575f0b9},
+		{0xffffffffffffffff, 0xb4d055fcf2cbbd7b},
+		// First output of splitmix64 seeded with 0
+		{0x9e3779b97f4a7c15, 0xe220a8397b1dcdaf},
+	}
+	for _, tt := range tests {
+		if got := mix64(tt.in); got != tt.want {
+			t.Errorf("mix64(%#x) = %#x, want %#x", tt.in, got, tt.want)
+		}
+	}
+}
+
+func TestSketchEstimate(t *testing.T) {
+	if nativeEndian != binary.LittleEndian {
+		t.Skip("vectors are for little-endian hosts")
+	}
+	src := ipv4Key{203, 0, 113, 7}
+	tests := []struct {
+		rule ruleKey
+		cols [cmsDepth]int // counter per row the program increments
+	}{
+		{newRuleKey(protoTCP, 4040), [cmsDepth]int{674, 694, 289, 570}},
+		{newRuleKey(protoICMP, 8<<8|icmpCodeAny), [cmsDepth]int{911, 341, 684, 994}},
+	}
+	for _, tt := range tests {
+		f := flowKey{src, tt.rule}
+		var s talkerSketch
+		for i, col := range tt.cols {
+			s[i][col] = uint32(10 + i)
+		}
+		// The estimate is the smallest of the flow's counters
+		if got := s.estimate(f); got != 10 {
+			t.Errorf("estimate(%v) = %d, want 10", tt.rule, got)
+		}
+		s[0][tt.cols[0]] = 0
+		if got := s.estimate(f); got != 0 {
+			t.Errorf("estimate(%v) with a zero counter = %d, want 0", tt.rule, got)
+		}
+	}
+}
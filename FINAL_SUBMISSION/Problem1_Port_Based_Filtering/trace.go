@@ -0,0 +1,55 @@
+package main
+
+import "github.com/cilium/ebpf"
+
+// tracePathNames are the code paths of enum trace_path in the eBPF program.
+var tracePathNames = []string{"non-ip", "other proto", "no match", "match", "drop"}
+
+// loadSpec returns the production build, or the FILTER_TRACE build, with
+// the source blocklist maps sized for blocklistCapacity addresses.
+func loadSpec(trace bool, blocklistCapacity uint32) (*ebpf.CollectionSpec, error) {
+	load := LoadPacketFilter
+	if trace {
+		load = LoadPacketFilterTrace
+	}
+	spec, err := load()
+	if err != nil {
+		return nil, err
+	}
+	sizeBlocklist(spec, blocklistCapacity)
+	return spec, nil
+}
+
+// sizeBlocklist sizes the source blocklist maps of spec for capacity
+// addresses.
+func sizeBlocklist(spec *ebpf.CollectionSpec, capacity uint32) {
+	spec.Maps["src_bloom_map"].MaxEntries = capacity
+	spec.Maps["blocked_src_map"].MaxEntries = capacity
+	spec.Maps["src_expiry_map"].MaxEntries = capacity
+}
+
+// loadObjects loads a spec from loadSpec, returning the trace_events map
+// too for the FILTER_TRACE build. With a pinPath, every map is pinned
+// there by name so that it outlives the process.
+func loadObjects(spec *ebpf.CollectionSpec, pinPath string) (*PacketFilterObjects, *ebpf.Map, error) {
+	var opts *ebpf.CollectionOptions
+	if pinPath != "" {
+		for _, m := range spec.Maps {
+			m.Pinning = ebpf.PinByName
+		}
+		opts = &ebpf.CollectionOptions{Maps: ebpf.MapOptions{PinPath: pinPath}}
+	}
+
+	if _, trace := spec.Maps["trace_events"]; !trace {
+		objs := &PacketFilterObjects{}
+		return objs, nil, spec.LoadAndAssign(objs, opts)
+	}
+	objs := &struct {
+		PacketFilterObjects
+		TraceEvents *ebpf.Map `ebpf:"trace_events"`
+	}{}
+	if err := spec.LoadAndAssign(objs, opts); err != nil {
+		return nil, nil, err
+	}
+	return &objs.PacketFilterObjects, objs.TraceEvents, nil
+}
@@ -0,0 +1,62 @@
+package main
+
+import (
+	"log"
+	"strconv"
+
+	"filter-common/bench"
+	"filter-common/sizing"
+	"github.com/cilium/ebpf"
+)
+
+// runBench measures the per-packet cost of process_specific_filter with
+// BPF_PROG_TEST_RUN, for TCP and UDP to the target process and for ICMP,
+// which is never attributed to a process. Usage: process-filter bench [allowed_port]
+func runBench(args []string) {
+	allowedPort := uint16(4040)
+	if len(args) > 0 {
+		port, err := strconv.Atoi(args[0])
+		if err != nil || port < 4000 || port > 5000 {
+			log.Fatalf("Usage: process-filter bench [allowed_port]: port must be in 4000-5000")
+		}
+		allowedPort = uint16(port)
+	}
+
+	spec, err := LoadProcessFilter()
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	if err := sizing.SetupMemlock(spec, 0); err != nil {
+		log.Fatalf("Failed to remove memlock limit: %v", err)
+	}
+	coll, err := ebpf.NewCollection(spec)
+	if err != nil {
+		log.Fatalf("Failed to create eBPF collection: %v", err)
+	}
+	defer coll.Close()
+
+	if err := coll.Maps["target_process_map"].Put(uint32(0), makeComm("myprocess")); err != nil {
+		log.Fatalf("Failed to set target process name: %v", err)
+	}
+	if err := coll.Maps["allowed_port_map"].Put(uint32(0), allowedPort); err != nil {
+		log.Fatalf("Failed to set allowed port: %v", err)
+	}
+
+	// Ports 4000-5000 are attributed to the target process by the program
+	loopback := [4]byte{127, 0, 0, 1}
+	blockedPort := allowedPort + 1
+	if blockedPort > 5000 {
+		blockedPort = allowedPort - 1
+	}
+	cases := []bench.Case{
+		{Name: "non-ip", Pkt: bench.EthFrame(0x0806, 46), Want: bench.XDPPass},
+		{Name: "tcp allowed", Pkt: bench.TCPPacket(loopback, loopback, allowedPort), Want: bench.XDPPass},
+		{Name: "tcp blocked", Pkt: bench.TCPPacket(loopback, loopback, blockedPort), Want: bench.XDPDrop},
+		{Name: "udp allowed", Pkt: bench.UDPPacket(loopback, loopback, allowedPort), Want: bench.XDPPass},
+		{Name: "udp blocked", Pkt: bench.UDPPacket(loopback, loopback, blockedPort), Want: bench.XDPDrop},
+		{Name: "icmp", Pkt: bench.ICMPPacket(loopback, loopback, 8, 0), Want: bench.XDPPass},
+		{Name: "other", Pkt: bench.TCPPacket(loopback, loopback, 8080), Want: bench.XDPPass},
+	}
+
+	bench.Run(coll.Programs["process_specific_filter"], cases)
+}
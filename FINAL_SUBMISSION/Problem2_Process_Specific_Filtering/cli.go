@@ -0,0 +1,406 @@
+package main
+
+import (
+	"fmt"
+	"log"
+	"os"
+	"os/signal"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"time"
+
+	"filter-common/bpfmap"
+	"filter-common/sizing"
+	"filter-common/traffic"
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/link"
+	"github.com/vishvananda/netlink"
+)
+
+// pinDir holds the maps pinned by "apply", and linkDir its links, so the
+// filter keeps running after the command exits and later commands can
+// find it.
+const (
+	pinDir  = "/sys/fs/bpf/process-filter"
+	linkDir = pinDir + "/links"
+)
+
+// xdpLinkPrefix names the pinned XDP link after its interface, and
+// cgroupLinkSuffix the pinned cgroup links after the id of their cgroup.
+const (
+	xdpLinkPrefix    = "xdp_"
+	cgroupLinkSuffix = "_cgroup"
+)
+
+// runApply deploys a policy file, or updates the maps of a filter that is
+// already attached. Usage: process-filter apply <policy.json>
+func runApply(args []string) {
+	if len(args) != 1 {
+		log.Fatalf("Usage: process-filter apply <policy.json>")
+	}
+	policy, err := loadPolicy(args[0])
+	if err != nil {
+		log.Fatalf("Failed to load policy: %v", err)
+	}
+
+	start := time.Now()
+	if attached, ok := attachedInterface(); ok {
+		if attached != policy.iface {
+			log.Fatalf("Filter is attached to %s; run detach before moving it to %s", attached, policy.iface)
+		}
+		// The cgroup programs stay where they were attached, so a new
+		// cgroup is not something a map update can deliver
+		id, err := cgroupID(policy.cgroup)
+		if err != nil {
+			log.Fatalf("Failed to resolve cgroup: %v", err)
+		}
+		if attachedID, ok := attachedCgroup(); ok && attachedID != id {
+			log.Fatalf("Filter is attached to cgroup id %d; run detach before moving it to %s (id %d)",
+				attachedID, policy.cgroup, id)
+		}
+		maps, err := loadPinnedMaps()
+		if err != nil {
+			log.Fatalf("Failed to open pinned maps: %v", err)
+		}
+		defer closeMaps(maps)
+		if err := applyPolicy(maps, policy); err != nil {
+			log.Fatalf("Failed to apply policy: %v", err)
+		}
+		fmt.Printf("✅ Policy updated on %s in %v\n", policy.iface, time.Since(start))
+		return
+	}
+
+	// Undo a partial deployment before bailing out
+	abort := func(format string, v ...interface{}) {
+		os.RemoveAll(pinDir)
+		log.Fatalf(format, v...)
+	}
+
+	spec, err := LoadProcessFilter()
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	if err := sizing.SetupMemlock(spec, policy.budget); err != nil {
+		log.Fatalf("Failed to set memlock limit: %v", err)
+	}
+
+	iface, err := netlink.LinkByName(policy.iface)
+	if err != nil {
+		log.Fatalf("Failed to get interface %s: %v", policy.iface, err)
+	}
+	cgroup, err := cgroupID(policy.cgroup)
+	if err != nil {
+		log.Fatalf("Failed to resolve cgroup: %v", err)
+	}
+
+	// Maps left behind without links are from an interrupted apply
+	if err := os.RemoveAll(pinDir); err != nil {
+		log.Fatalf("Failed to clean %s: %v", pinDir, err)
+	}
+	if err := os.MkdirAll(linkDir, 0700); err != nil {
+		log.Fatalf("Failed to create %s (is bpffs mounted?): %v", linkDir, err)
+	}
+
+	for _, m := range spec.Maps {
+		m.Pinning = ebpf.PinByName
+	}
+	coll, err := ebpf.NewCollectionWithOptions(spec, ebpf.CollectionOptions{
+		Maps: ebpf.MapOptions{PinPath: pinDir},
+	})
+	if err != nil {
+		abort("Failed to create eBPF collection: %v", err)
+	}
+	defer coll.Close()
+
+	if err := bpfmap.BatchPut(coll.Maps["stats_map"], []uint32{0, 1, 2, 3}, make([]uint64, 4)); err != nil {
+		abort("Failed to initialize statistics counters: %v", err)
+	}
+
+	// The exec/exit tracepoints are perf event links, which cannot be
+	// pinned, so nothing keeps process_map current once apply exits.
+	// applyPolicy leaves it empty and comm: policies match the comm of the
+	// connecting task instead.
+	if len(policy.policies.byComm) > 0 {
+		fmt.Printf("ℹ️  comm: policies match the current comm of a task; exec-time tracking needs the foreground loader\n")
+	}
+
+	if err := applyPolicy(coll.Maps, policy); err != nil {
+		abort("Failed to apply policy: %v", err)
+	}
+
+	for _, a := range []struct {
+		name   string
+		attach func() (link.Link, error)
+	}{
+		{xdpLinkPrefix + policy.iface, func() (link.Link, error) {
+			return link.AttachXDP(link.XDPOptions{
+				Program:   coll.Programs["process_specific_filter"],
+				Interface: iface.Attrs().Index,
+				Flags:     link.XDPGenericMode,
+			})
+		}},
+		{fmt.Sprintf("connect4%s%d", cgroupLinkSuffix, cgroup), func() (link.Link, error) {
+			return link.AttachCgroup(link.CgroupOptions{
+				Path:    policy.cgroup,
+				Attach:  ebpf.AttachCGroupInet4Connect,
+				Program: coll.Programs["process_connect_filter"],
+			})
+		}},
+		{fmt.Sprintf("sendmsg4%s%d", cgroupLinkSuffix, cgroup), func() (link.Link, error) {
+			return link.AttachCgroup(link.CgroupOptions{
+				Path:    policy.cgroup,
+				Attach:  ebpf.AttachCGroupUDP4Sendmsg,
+				Program: coll.Programs["process_sendmsg_filter"],
+			})
+		}},
+	} {
+		l, err := a.attach()
+		if err != nil {
+			abort("Failed to attach %s: %v", a.name, err)
+		}
+		defer l.Close()
+		if err := l.Pin(filepath.Join(linkDir, a.name)); err != nil {
+			abort("Failed to pin %s link: %v", a.name, err)
+		}
+	}
+
+	fmt.Printf("✅ Process-specific filter attached to %s and %s in %v, pinned at %s\n",
+		policy.iface, policy.cgroup, time.Since(start), pinDir)
+	if sizes, err := sizing.Maps(coll.Maps); err == nil {
+		sizing.Print(sizes, policy.budget)
+	}
+}
+
+// runSize prints the map memory a policy file would need, without loading
+// anything. Usage: process-filter size <policy.json>
+func runSize(args []string) {
+	if len(args) != 1 {
+		log.Fatalf("Usage: process-filter size <policy.json>")
+	}
+	policy, err := loadPolicy(args[0])
+	if err != nil {
+		log.Fatalf("Failed to load policy: %v", err)
+	}
+	spec, err := LoadProcessFilter()
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	sizes, err := sizing.Spec(spec)
+	if err != nil {
+		log.Fatalf("Failed to size maps: %v", err)
+	}
+	sizing.Print(sizes, policy.budget)
+}
+
+// applyPolicy writes a compiled policy into the filter's maps, touching only
+// entries that changed. process_map is emptied: without the exec/exit
+// tracepoints a pinned filter cannot keep it current, and a stale entry
+// would hand a dead process's policy to whatever reuses its PID.
+func applyPolicy(maps map[string]*ebpf.Map, policy *compiledPolicy) error {
+	key := uint32(0)
+	if err := maps["target_process_map"].Put(key, makeComm(policy.target)); err != nil {
+		return fmt.Errorf("target process: %w", err)
+	}
+	if err := bpfmap.BatchPut(maps["allowed_port_map"],
+		[]uint32{policyActive, policyShadow},
+		[]uint16{policy.allowedPort, policy.shadowPort}); err != nil {
+		return fmt.Errorf("allowed port: %w", err)
+	}
+	if err := maps["config_map"].Put(key, policy.config); err != nil {
+		return fmt.Errorf("filter mode: %w", err)
+	}
+	if err := policy.policies.apply(maps); err != nil {
+		return fmt.Errorf("process policies: %w", err)
+	}
+	if _, _, err := bpfmap.Sync(maps["process_map"], map[uint32]ProcessInfo{}); err != nil {
+		return fmt.Errorf("process map: %w", err)
+	}
+	return nil
+}
+
+// attachedInterface returns the interface of the pinned XDP link, if any.
+func attachedInterface() (string, bool) {
+	links, _ := filepath.Glob(filepath.Join(linkDir, xdpLinkPrefix+"*"))
+	if len(links) == 0 {
+		return "", false
+	}
+	return strings.TrimPrefix(filepath.Base(links[0]), xdpLinkPrefix), true
+}
+
+// attachedCgroup returns the cgroup id of the pinned connect4 link, if any.
+// Links pinned before the id was part of their name report none.
+func attachedCgroup() (uint64, bool) {
+	links, _ := filepath.Glob(filepath.Join(linkDir, "connect4"+cgroupLinkSuffix+"*"))
+	if len(links) == 0 {
+		return 0, false
+	}
+	id, err := strconv.ParseUint(strings.TrimPrefix(filepath.Base(links[0]), "connect4"+cgroupLinkSuffix), 10, 64)
+	return id, err == nil
+}
+
+// loadPinnedMaps opens the maps pinned by a previous apply, keyed by name
+// like Collection.Maps.
+func loadPinnedMaps() (map[string]*ebpf.Map, error) {
+	spec, err := LoadProcessFilter()
+	if err != nil {
+		return nil, err
+	}
+	maps := make(map[string]*ebpf.Map, len(spec.Maps))
+	for name := range spec.Maps {
+		m, err := ebpf.LoadPinnedMap(filepath.Join(pinDir, name), nil)
+		if err != nil {
+			closeMaps(maps)
+			return nil, fmt.Errorf("%s: %w", name, err)
+		}
+		maps[name] = m
+	}
+	return maps, nil
+}
+
+func closeMaps(maps map[string]*ebpf.Map) {
+	for _, m := range maps {
+		m.Close()
+	}
+}
+
+// countEntries returns the number of keys in a hash map.
+func countEntries(m *ebpf.Map) (int, error) {
+	var (
+		key   []byte
+		value []byte
+		n     int
+	)
+	iter := m.Iterate()
+	for iter.Next(&key, &value) {
+		n++
+	}
+	return n, iter.Err()
+}
+
+// pinnedTarget returns the process name the XDP path enforces.
+func pinnedTarget(maps map[string]*ebpf.Map) string {
+	var comm [16]int8
+	if err := maps["target_process_map"].Lookup(uint32(0), &comm); err != nil {
+		return ""
+	}
+	return commString(comm)
+}
+
+// runStatus prints where the filter is attached and what it enforces.
+func runStatus() {
+	iface, ok := attachedInterface()
+	if !ok {
+		fmt.Printf("❌ Process-specific filter is not attached (nothing pinned at %s)\n", pinDir)
+		os.Exit(1)
+	}
+	maps, err := loadPinnedMaps()
+	if err != nil {
+		log.Fatalf("Failed to open pinned maps: %v", err)
+	}
+	defer closeMaps(maps)
+
+	var config filterConfig
+	if err := maps["config_map"].Lookup(uint32(0), &config); err != nil {
+		log.Fatalf("Failed to read filter mode: %v", err)
+	}
+	var allowedPort uint16
+	maps["allowed_port_map"].Lookup(uint32(policyActive), &allowedPort)
+
+	counts := make(map[string]int)
+	for _, name := range []string{"policy_by_tgid", "policy_by_cgroup", "policy_by_comm", "process_map"} {
+		n, err := countEntries(maps[name])
+		if err != nil {
+			log.Fatalf("Failed to read %s: %v", name, err)
+		}
+		counts[name] = n
+	}
+	links, _ := os.ReadDir(linkDir)
+	var linkNames []string
+	for _, l := range links {
+		linkNames = append(linkNames, l.Name())
+	}
+
+	mode := "enforce"
+	if config.Mode == modeMonitor {
+		mode = "monitor"
+	}
+	target := pinnedTarget(maps)
+	xdp := "off (no comm: selector)"
+	if target != "" {
+		xdp = fmt.Sprintf("'%s' port %d", target, allowedPort)
+	}
+	fmt.Printf("✅ Process-specific filter attached to %s (pinned at %s, links: %s)\n",
+		iface, pinDir, strings.Join(linkNames, ", "))
+	fmt.Printf("📋 Mode: %s | XDP target %s | connect() policies: %d tgid, %d cgroup, %d comm | tracked processes: %d\n",
+		mode, xdp, counts["policy_by_tgid"], counts["policy_by_cgroup"],
+		counts["policy_by_comm"], counts["process_map"])
+	showStats(maps["stats_map"], target)
+	if sizes, err := sizing.Maps(maps); err != nil {
+		log.Printf("Failed to read map memory: %v", err)
+	} else {
+		sizing.Print(sizes, 0)
+	}
+}
+
+// runStats prints live rates from the pinned maps until interrupted.
+func runStats() {
+	if _, ok := attachedInterface(); !ok {
+		fmt.Printf("❌ Process-specific filter is not attached (nothing pinned at %s)\n", pinDir)
+		os.Exit(1)
+	}
+	maps, err := loadPinnedMaps()
+	if err != nil {
+		log.Fatalf("Failed to open pinned maps: %v", err)
+	}
+	defer closeMaps(maps)
+
+	target := pinnedTarget(maps)
+	rates := traffic.NewPrinter(maps["traffic_stats_map"], maps["queue_stats_map"], nil)
+	policy := &policyReporter{statsMap: maps["policy_stats_map"]}
+	policy.prev, _ = readPolicyStats(maps["policy_stats_map"])
+	fmt.Printf("📊 Statistics and per-queue rates will be shown every %v, press Ctrl+C to stop\n", traffic.Interval)
+
+	ticker := time.NewTicker(traffic.Interval)
+	defer ticker.Stop()
+	c := make(chan os.Signal, 1)
+	signal.Notify(c, os.Interrupt)
+	for {
+		select {
+		case <-ticker.C:
+			showStats(maps["stats_map"], target)
+			rates.Print(traffic.Interval)
+			policy.print(traffic.Interval)
+			showConnectStats(maps["connect_stats_map"])
+		case <-c:
+			return
+		}
+	}
+}
+
+// runDetach removes all pinned links, which detaches the programs, and the
+// pinned maps.
+func runDetach() {
+	iface, attached := attachedInterface()
+	links, _ := os.ReadDir(linkDir)
+	for _, e := range links {
+		path := filepath.Join(linkDir, e.Name())
+		l, err := link.LoadPinnedLink(path, nil)
+		if err != nil {
+			log.Fatalf("Failed to open pinned link %s: %v", path, err)
+		}
+		// Dropping the pin and the last fd detaches the program
+		if err := l.Unpin(); err != nil {
+			log.Fatalf("Failed to unpin %s: %v", path, err)
+		}
+		l.Close()
+	}
+	if err := os.RemoveAll(pinDir); err != nil {
+		log.Fatalf("Failed to remove %s: %v", pinDir, err)
+	}
+	if attached {
+		fmt.Printf("🛑 Process-specific filter detached from %s\n", iface)
+	} else {
+		fmt.Printf("🛑 Process-specific filter was not attached; cleaned %s\n", pinDir)
+	}
+}
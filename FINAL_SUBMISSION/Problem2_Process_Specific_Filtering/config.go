@@ -0,0 +1,145 @@
+package main
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"os"
+	"strings"
+
+	"filter-common/sizing"
+)
+
+// policyFile is the declarative policy read by "apply". packet-filter and
+// process-filter share the format; each enforces its own sections and
+// only checks that the others are well-formed JSON.
+//
+//	{
+//	  "interface": "eth0",
+//	  "mode": "enforce",
+//	  "sample_rate": 100,
+//	  "ports": {"block": "4040,8080"},
+//	  "cgroup": "/sys/fs/cgroup",
+//	  "memlock_budget": "64MiB",
+//	  "processes": [
+//	    {"select": "comm:myprocess", "allow": "4040"},
+//	    {"select": "comm:nginx", "allow": "80,443,8000-8100", "shadow": "80,443"},
+//	    {"select": "cgroup:/sys/fs/cgroup/batch.slice", "allow": "5432"}
+//	  ]
+//	}
+type policyFile struct {
+	Interface     string         `json:"interface"`
+	Mode          string         `json:"mode"`
+	SampleRate    uint32         `json:"sample_rate"`
+	Cgroup        string         `json:"cgroup"`
+	Processes     []processEntry `json:"processes"`
+	MemlockBudget string         `json:"memlock_budget"`
+
+	// Enforced by packet-filter
+	Ports         json.RawMessage `json:"ports"`
+	Blocklist     json.RawMessage `json:"blocklist"`
+	BlocklistFile json.RawMessage `json:"blocklist_file"`
+	TalkersPass   json.RawMessage `json:"talkers_pass"`
+}
+
+// processEntry is one line of a policy file in JSON form.
+type processEntry struct {
+	Select string `json:"select"`
+	Allow  string `json:"allow"`
+	Shadow string `json:"shadow"`
+}
+
+// compiledPolicy is a policy file turned into map contents.
+type compiledPolicy struct {
+	iface    string
+	cgroup   string
+	config   filterConfig
+	policies *policySet
+	budget   uint64
+
+	// The XDP path enforces a single process and port; it follows the
+	// first comm: selector and is off, with no target, when there is none.
+	target      string
+	allowedPort uint16
+	shadowPort  uint16
+}
+
+// loadPolicy reads a policy file and compiles it in one pass. Unknown keys
+// are rejected so that a typo does not silently drop a rule.
+func loadPolicy(path string) (*compiledPolicy, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	var pf policyFile
+	dec := json.NewDecoder(bytes.NewReader(data))
+	dec.DisallowUnknownFields()
+	if err := dec.Decode(&pf); err != nil {
+		return nil, fmt.Errorf("%s: %w", path, err)
+	}
+
+	policy := &compiledPolicy{
+		iface:    pf.Interface,
+		cgroup:   pf.Cgroup,
+		config:   filterConfig{SampleRate: pf.SampleRate},
+		policies: newPolicySet(),
+	}
+	if policy.iface == "" {
+		policy.iface = "lo"
+	}
+	if policy.cgroup == "" {
+		policy.cgroup = "/sys/fs/cgroup"
+	}
+	switch pf.Mode {
+	case "", "enforce":
+		policy.config.Mode = modeEnforce
+	case "monitor":
+		policy.config.Mode = modeMonitor
+	default:
+		return nil, fmt.Errorf("%s: unknown mode %q (want enforce or monitor)", path, pf.Mode)
+	}
+
+	if policy.budget, err = sizing.ParseSize(pf.MemlockBudget); err != nil {
+		return nil, fmt.Errorf("%s: memlock_budget: %w", path, err)
+	}
+
+	for i, e := range pf.Processes {
+		var p processPolicy
+		if p.Active, err = parsePortRanges(e.Allow); err != nil {
+			return nil, fmt.Errorf("%s: processes[%d]: %w", path, i, err)
+		}
+		if e.Shadow != "" {
+			if p.Shadow, err = parsePortRanges(e.Shadow); err != nil {
+				return nil, fmt.Errorf("%s: processes[%d]: %w", path, i, err)
+			}
+			p.Flags |= processPolicyFlagShadow
+		}
+		if err := policy.policies.add(e.Select, p); err != nil {
+			return nil, fmt.Errorf("%s: processes[%d]: %w", path, i, err)
+		}
+
+		if name, ok := strings.CutPrefix(e.Select, "comm:"); ok && policy.target == "" {
+			policy.target = name
+			if policy.allowedPort, err = singlePort(p.Active); err != nil {
+				return nil, fmt.Errorf("%s: processes[%d]: allow %q: %w", path, i, e.Allow, err)
+			}
+			if p.Flags&processPolicyFlagShadow != 0 {
+				if policy.shadowPort, err = singlePort(p.Shadow); err != nil {
+					return nil, fmt.Errorf("%s: processes[%d]: shadow %q: %w", path, i, e.Shadow, err)
+				}
+			}
+		}
+	}
+	return policy, nil
+}
+
+// singlePort returns the port of a policy the XDP path can enforce: one
+// port for both TCP and UDP. The first comm: selector drives the XDP path,
+// so anything wider is rejected rather than truncated.
+func singlePort(p portPolicy) (uint16, error) {
+	r := p.Ranges[0]
+	if p.NrRanges != 1 || r.Lo != r.Hi || r.Proto != 0 {
+		return 0, fmt.Errorf("the first comm: selector drives the XDP path and must allow a single port for both tcp and udp")
+	}
+	return r.Lo, nil
+}
@@ -0,0 +1,161 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"log"
+	"os"
+	"strconv"
+	"strings"
+	"sync"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/ringbuf"
+)
+
+// Event types, as in the eBPF program.
+const (
+	processEventExec = 1
+	processEventExit = 2
+)
+
+// processEvent mirrors struct process_event in the eBPF program.
+type processEvent struct {
+	Type uint32
+	Info ProcessInfo
+}
+
+func commString(comm [16]int8) string {
+	var b strings.Builder
+	for _, c := range comm {
+		if c == 0 {
+			break
+		}
+		b.WriteByte(byte(c))
+	}
+	return b.String()
+}
+
+func makeComm(name string) [16]int8 {
+	var comm [16]int8
+	for i := 0; i < len(name) && i < len(comm)-1; i++ {
+		comm[i] = int8(name[i])
+	}
+	return comm
+}
+
+// processTracker is the userspace view of process_map. The kernel owns the
+// map; the tracker follows it through exec/exit events.
+type processTracker struct {
+	mu    sync.Mutex
+	procs map[uint32]ProcessInfo
+}
+
+func newProcessTracker() *processTracker {
+	return &processTracker{procs: make(map[uint32]ProcessInfo)}
+}
+
+// seed adds processes that were already running before the tracepoints
+// were attached and whose comm has a policy. This is a one-off scan of
+// /proc at startup; from then on the kernel keeps process_map current.
+//
+// The tracepoints run concurrently with the scan. Entries are only added
+// if the exec tracepoint has not written a fresher one meanwhile, and a
+// process that exited between the scan and the insert, after its exit
+// event, is removed again.
+func (pt *processTracker) seed(m *ebpf.Map, byComm map[commKey]processPolicy) error {
+	entries, err := os.ReadDir("/proc")
+	if err != nil {
+		return err
+	}
+
+	seeded := make(map[uint32]ProcessInfo)
+	for _, e := range entries {
+		tgid, err := strconv.ParseUint(e.Name(), 10, 32)
+		if err != nil {
+			continue
+		}
+		comm, err := os.ReadFile("/proc/" + e.Name() + "/comm")
+		if err != nil {
+			continue // exited meanwhile
+		}
+		name := strings.TrimSuffix(string(comm), "\n")
+		if _, ok := byComm[makeCommKey(name)]; !ok {
+			continue
+		}
+		info := ProcessInfo{Comm: makeComm(name), PID: uint32(tgid), TGID: uint32(tgid)}
+		err = m.Update(uint32(tgid), info, ebpf.UpdateNoExist)
+		if errors.Is(err, ebpf.ErrKeyExist) {
+			continue // exec event got there first
+		}
+		if err != nil {
+			return err
+		}
+		seeded[uint32(tgid)] = info
+	}
+
+	for tgid, info := range seeded {
+		if _, err := os.Stat("/proc/" + strconv.FormatUint(uint64(tgid), 10)); err == nil {
+			continue
+		}
+		// Only drop our own entry, not one for a process that reused the PID
+		var cur ProcessInfo
+		if err := m.Lookup(tgid, &cur); err == nil && cur == info {
+			if err := m.Delete(tgid); err != nil && !errors.Is(err, ebpf.ErrKeyNotExist) {
+				return err
+			}
+		}
+		delete(seeded, tgid)
+	}
+
+	pt.mu.Lock()
+	defer pt.mu.Unlock()
+	for tgid, info := range seeded {
+		pt.procs[tgid] = info
+	}
+	return nil
+}
+
+// run applies exec/exit events until the reader is closed.
+func (pt *processTracker) run(rd *ringbuf.Reader) {
+	for {
+		rec, err := rd.Read()
+		if errors.Is(err, ringbuf.ErrClosed) {
+			return
+		}
+		if err != nil {
+			log.Printf("Failed to read process event: %v", err)
+			continue
+		}
+		var ev processEvent
+		if err := binary.Read(bytes.NewReader(rec.RawSample), nativeEndian, &ev); err != nil {
+			log.Printf("Failed to decode process event: %v", err)
+			continue
+		}
+
+		pt.mu.Lock()
+		switch ev.Type {
+		case processEventExec:
+			pt.procs[ev.Info.TGID] = ev.Info
+			fmt.Printf("🚀 Tracking '%s' (PID %d)\n", commString(ev.Info.Comm), ev.Info.TGID)
+		case processEventExit:
+			delete(pt.procs, ev.Info.TGID)
+			fmt.Printf("👋 '%s' (PID %d) exited\n", commString(ev.Info.Comm), ev.Info.TGID)
+		}
+		pt.mu.Unlock()
+	}
+}
+
+// pids returns the tracked PIDs per process name.
+func (pt *processTracker) pids() map[string][]uint32 {
+	pt.mu.Lock()
+	defer pt.mu.Unlock()
+	byName := make(map[string][]uint32)
+	for tgid, info := range pt.procs {
+		name := commString(info.Comm)
+		byName[name] = append(byName[name], tgid)
+	}
+	return byName
+}
@@ -3,11 +3,16 @@ module process-filter
 go 1.21
 
 require (
-	github.com/cilium/ebpf v0.11.0
+	filter-common v0.0.0
+	github.com/cilium/ebpf v0.12.3
 	github.com/vishvananda/netlink v1.1.0
+	golang.org/x/sys v0.15.0
 )
 
 require (
 	github.com/vishvananda/netns v0.0.0-20191106174202-0a2b9b5464df // indirect
-	golang.org/x/sys v0.10.0 // indirect
+	golang.org/x/exp v0.0.0-20230224173230-c95f2b4c22f2 // indirect
 )
+
+// Go code shared by both filters
+replace filter-common => ../common
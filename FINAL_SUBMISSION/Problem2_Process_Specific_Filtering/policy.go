@@ -0,0 +1,137 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"log"
+	"net"
+	"time"
+	"unsafe"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/ringbuf"
+)
+
+// Policy slots and filter modes, as in the eBPF program.
+const (
+	policyActive = 0
+	policyShadow = 1
+
+	modeEnforce = 0
+	modeMonitor = 1
+)
+
+// xdpDrop is XDP_DROP in enum xdp_action, the verdict samples carry.
+const xdpDrop = 1
+
+// filterConfig mirrors struct filter_config in the eBPF program.
+type filterConfig struct {
+	Mode       uint32
+	SampleRate uint32
+}
+
+// policyStats mirrors struct policy_stats in the eBPF program.
+type policyStats struct {
+	Allowed [2]uint64
+	Blocked [2]uint64
+}
+
+// matchSample mirrors struct match_sample in the eBPF program.
+type matchSample struct {
+	Saddr    [4]byte
+	Daddr    [4]byte
+	Sport    uint16
+	Dport    uint16
+	Policies uint8
+	Verdict  uint8
+	Pad      uint16
+}
+
+var nativeEndian binary.ByteOrder = func() binary.ByteOrder {
+	x := uint16(1)
+	if *(*byte)(unsafe.Pointer(&x)) == 1 {
+		return binary.LittleEndian
+	}
+	return binary.BigEndian
+}()
+
+func readPolicyStats(m *ebpf.Map) (policyStats, error) {
+	var (
+		perCPU []policyStats
+		sum    policyStats
+	)
+	if err := m.Lookup(uint32(0), &perCPU); err != nil {
+		return sum, err
+	}
+	for _, s := range perCPU {
+		for i := range sum.Allowed {
+			sum.Allowed[i] += s.Allowed[i]
+			sum.Blocked[i] += s.Blocked[i]
+		}
+	}
+	return sum, nil
+}
+
+// policyReporter diffs the active and shadow policy counters.
+type policyReporter struct {
+	statsMap *ebpf.Map
+	prev     policyStats
+}
+
+// print shows what the active and the shadow policy decided for the target
+// process over the last interval.
+func (pr *policyReporter) print(interval time.Duration) {
+	cur, err := readPolicyStats(pr.statsMap)
+	if err != nil {
+		log.Printf("Failed to read policy statistics: %v", err)
+		return
+	}
+	secs := interval.Seconds()
+	rate := func(c, p [2]uint64, i int) float64 { return float64(c[i]-p[i]) / secs }
+	activeBlocked := rate(cur.Blocked, pr.prev.Blocked, policyActive)
+	shadowBlocked := rate(cur.Blocked, pr.prev.Blocked, policyShadow)
+	fmt.Printf("🔍 Policy: active allows %.0f pps, blocks %.0f pps | shadow allows %.0f pps, blocks %.0f pps | Δ blocked %+.0f pps\n",
+		rate(cur.Allowed, pr.prev.Allowed, policyActive), activeBlocked,
+		rate(cur.Allowed, pr.prev.Allowed, policyShadow), shadowBlocked,
+		shadowBlocked-activeBlocked)
+	pr.prev = cur
+}
+
+// readSamples prints sampled would-be drops until the reader is closed.
+func readSamples(rd *ringbuf.Reader) {
+	for {
+		rec, err := rd.Read()
+		if errors.Is(err, ringbuf.ErrClosed) {
+			return
+		}
+		if err != nil {
+			log.Printf("Failed to read sample: %v", err)
+			continue
+		}
+		var s matchSample
+		if err := binary.Read(bytes.NewReader(rec.RawSample), nativeEndian, &s); err != nil {
+			log.Printf("Failed to decode sample: %v", err)
+			continue
+		}
+		verdict := "pass"
+		if s.Verdict == xdpDrop {
+			verdict = "drop"
+		}
+		fmt.Printf("🔎 %s:%d -> %s:%d blocked by=%s verdict=%s\n",
+			net.IP(s.Saddr[:]), s.Sport, net.IP(s.Daddr[:]), s.Dport, policyNames(s.Policies), verdict)
+	}
+}
+
+func policyNames(bits uint8) string {
+	switch bits & (1<<policyActive | 1<<policyShadow) {
+	case 1 << policyActive:
+		return "active"
+	case 1 << policyShadow:
+		return "shadow"
+	case 1<<policyActive | 1<<policyShadow:
+		return "active,shadow"
+	}
+	return "none"
+}
@@ -1,6 +1,6 @@
 //go:build ignore
 
-// Self-contained eBPF program for process-specific TCP port filtering
+// Self-contained eBPF program for process-specific TCP/UDP port filtering
 // Allows traffic only on port 4040 for process "myprocess"
 // Drops traffic to all other ports for that process
 
@@ -33,6 +33,17 @@ struct xdp_md {
     __u32 rx_queue_index;
 };
 
+// Context of cgroup/connect4 and cgroup/sendmsg4 programs (leading fields only)
+struct bpf_sock_addr {
+    __u32 user_family;
+    __u32 user_ip4;      // network byte order
+    __u32 user_ip6[4];
+    __u32 user_port;     // network byte order
+    __u32 family;
+    __u32 type;
+    __u32 protocol;
+};
+
 // Network header structures
 struct ethhdr {
     unsigned char h_dest[6];
@@ -54,21 +65,334 @@ struct iphdr {
     __u32 daddr;
 } __attribute__((packed));
 
-struct tcphdr {
+// TCP and UDP headers both start with the ports, so one bounds check
+// covers either protocol
+struct l4hdr {
     __u16 source;
     __u16 dest;
-    __u32 seq;
-    __u32 ack_seq;
-    __u16 flags;  // Simplified - combine all flag fields
-    __u16 window;
-    __u16 check;
-    __u16 urg_ptr;
 } __attribute__((packed));
 
 // Constants
 #define ETH_P_IP 0x0800
 #define IPPROTO_TCP 6
+#define IPPROTO_UDP 17
 #define INADDR_LOOPBACK 0x7f000001
+#define TASK_COMM_LEN 16
+
+// BPF map definitions
+enum bpf_map_type {
+    BPF_MAP_TYPE_HASH = 1,
+    BPF_MAP_TYPE_ARRAY = 2,
+    BPF_MAP_TYPE_PERF_EVENT_ARRAY = 4,
+    BPF_MAP_TYPE_PERCPU_HASH = 5,
+    BPF_MAP_TYPE_PERCPU_ARRAY = 6,
+    BPF_MAP_TYPE_RINGBUF = 27,
+};
+
+#define BPF_NOEXIST 1
+
+#define __uint(name, val) int (*name)[val]
+#define __type(name, val) typeof(val) *name
+
+// Process tracked by the filter (mirrors ProcessInfo in process_manager.go)
+struct process_info {
+    char comm[TASK_COMM_LEN];
+    __u32 pid;
+    __u32 tgid;
+};
+
+// Name of the process the XDP policy applies to (key 0). An empty name
+// turns the XDP check off.
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, char[TASK_COMM_LEN]);
+} target_process_map SEC(".maps");
+
+// The only port the target process may use
+// Key 0: enforcing policy, key 1: shadow (candidate) policy, 0 = not
+// configured, which turns the XDP check off for that policy
+#define POLICY_ACTIVE 0
+#define POLICY_SHADOW 1
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 2);
+    __type(key, __u32);
+    __type(value, __u16);
+} allowed_port_map SEC(".maps");
+
+// Per-process port policies, applied at connect() time where the calling
+// process is known. A policy is a short list of allowed port ranges; a
+// single port is a range with lo == hi, and a range applies to one IP
+// protocol or, with proto 0, to both TCP and UDP. Lookups are by TGID, then
+// cgroup id, then comm, each a single hash lookup.
+#define MAX_PORT_RANGES 16
+#define PROCESS_POLICY_F_SHADOW (1 << 0)  // shadow ranges are configured
+
+struct port_range {
+    __u16 lo;
+    __u16 hi;
+    __u8 proto;  // IPPROTO_TCP, IPPROTO_UDP or 0 for any
+    __u8 pad[3];
+};
+
+struct port_policy {
+    __u32 nr_ranges;
+    struct port_range ranges[MAX_PORT_RANGES];
+};
+
+struct process_policy {
+    __u32 flags;
+    struct port_policy active;
+    struct port_policy shadow;
+};
+
+struct comm_key {
+    char comm[TASK_COMM_LEN];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 4096);
+    __type(key, __u32);
+    __type(value, struct process_policy);
+} policy_by_tgid SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 1024);
+    __type(key, __u64);
+    __type(value, struct process_policy);
+} policy_by_cgroup SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 1024);
+    __type(key, struct comm_key);
+    __type(value, struct process_policy);
+} policy_by_comm SEC(".maps");
+
+// Connect decisions (index 0: active policy, 1: shadow policy)
+struct connect_stats {
+    __u64 allowed[2];
+    __u64 blocked[2];
+    __u64 unmatched;  // caller has no policy
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct connect_stats);
+} connect_stats_map SEC(".maps");
+
+// Runtime configuration (key 0)
+#define MODE_ENFORCE 0
+#define MODE_MONITOR 1  // evaluate and count the policy, but always pass
+
+struct filter_config {
+    __u32 mode;
+    __u32 sample_rate;  // sample 1 in N would-be drops to userspace, 0 = off
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct filter_config);
+} config_map SEC(".maps");
+
+// Verdicts of the active and shadow policy for target-process traffic
+struct policy_stats {
+    __u64 allowed[2];
+    __u64 blocked[2];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct policy_stats);
+} policy_stats_map SEC(".maps");
+
+// Sampled would-be drops; policies is a bitmask of (1 << POLICY_*)
+struct match_sample {
+    __u32 saddr;
+    __u32 daddr;
+    __u16 sport;
+    __u16 dport;
+    __u8 policies;
+    __u8 verdict;
+    __u16 pad;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024);
+} samples_map SEC(".maps");
+
+// Processes under monitoring, keyed by TGID. Maintained in the kernel by
+// the exec/exit tracepoints below for every process whose comm has a policy.
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 16384);
+    __type(key, __u32);
+    __type(value, struct process_info);
+} process_map SEC(".maps");
+
+// Notifies userspace of processes entering and leaving process_map
+#define PROCESS_EVENT_EXEC 1
+#define PROCESS_EVENT_EXIT 2
+
+struct process_event {
+    __u32 type;
+    struct process_info info;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 64 * 1024);
+} process_events SEC(".maps");
+
+// Packet statistics
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 4);  // 0: total, 1: allowed, 2: blocked, 3: other processes
+    __type(key, __u32);
+    __type(value, __u64);
+} stats_map SEC(".maps");
+
+#define STAT_TOTAL   0
+#define STAT_ALLOWED 1
+#define STAT_BLOCKED 2
+#define STAT_OTHER   3
+
+// Per-RX-queue counters, used to spot RSS imbalance
+struct queue_key {
+    __u32 ifindex;
+    __u32 rx_queue;
+};
+
+struct queue_stats {
+    __u64 pass;
+    __u64 drop;
+    __u64 bytes;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, 1024);
+    __type(key, struct queue_key);
+    __type(value, struct queue_stats);
+} queue_stats_map SEC(".maps");
+
+// Per-verdict packet/byte counters and a log2 packet-size histogram.
+// Kept in one per-CPU slot so accounting costs a single lookup.
+#define VERDICT_PASS 0
+#define VERDICT_DROP 1
+#define SIZE_HIST_BUCKETS 16  // bucket i: [2^i, 2^(i+1)) bytes
+
+struct traffic_stats {
+    __u64 packets[2];
+    __u64 bytes[2];
+    __u64 size_hist[SIZE_HIST_BUCKETS];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct traffic_stats);
+} traffic_stats_map SEC(".maps");
+
+// BPF helper function declarations
+static void *(*bpf_map_lookup_elem)(void *map, void *key) = (void *) 1;
+static long (*bpf_map_update_elem)(void *map, void *key, void *value, __u64 flags) = (void *) 2;
+static long (*bpf_map_delete_elem)(void *map, void *key) = (void *) 3;
+static __u32 (*bpf_get_prandom_u32)(void) = (void *) 7;
+static long (*bpf_ringbuf_output)(void *ringbuf, void *data, __u64 size, __u64 flags) = (void *) 130;
+static __u64 (*bpf_get_current_pid_tgid)(void) = (void *) 14;
+static long (*bpf_get_current_comm)(void *buf, __u32 size_of_buf) = (void *) 16;
+static __u64 (*bpf_get_current_cgroup_id)(void) = (void *) 80;
+static __u64 (*bpf_get_current_task)(void) = (void *) 35;
+static long (*bpf_probe_read_kernel)(void *dst, __u32 size, const void *unsafe_ptr) = (void *) 113;
+
+// Kernel structures read through CO-RE. Only the fields used are declared;
+// preserve_access_index makes clang emit relocations that the loader fixes
+// up against the running kernel's BTF.
+typedef struct {
+    int counter;
+} __attribute__((preserve_access_index)) atomic_t;
+
+struct signal_struct {
+    atomic_t live;           // threads of the group that have not exited
+} __attribute__((preserve_access_index));
+
+struct task_struct {
+    struct signal_struct *signal;
+} __attribute__((preserve_access_index));
+
+// Packet-trace mode, compiled in only with -DFILTER_TRACE. Records entry and
+// exit timestamps, the parse path taken and the verdict of every packet to a
+// per-CPU perf ring buffer. Without FILTER_TRACE the macros expand to nothing.
+enum trace_path {
+    TRACE_PATH_NON_IP = 0,    // truncated or non-IPv4 frame
+    TRACE_PATH_OTHER_PROTO,   // IPv4 but not (complete) TCP or UDP
+    TRACE_PATH_NO_MATCH,      // ports parsed, not target-process traffic
+    TRACE_PATH_MATCH,         // target process, packet passes
+    TRACE_PATH_DROP,          // target process, packet dropped
+};
+
+#ifdef FILTER_TRACE
+#define BPF_F_CURRENT_CPU 0xffffffffULL
+
+struct trace_event {
+    __u64 start_ns;
+    __u64 end_ns;
+    __u32 path;
+    __u32 verdict;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u32));
+} trace_events SEC(".maps");
+
+static __u64 (*bpf_ktime_get_ns)(void) = (void *) 5;
+static long (*bpf_trace_printk)(const char *fmt, __u32 fmt_size, ...) = (void *) 6;
+static long (*bpf_perf_event_output)(void *ctx, void *map, __u64 flags, void *data, __u64 size) = (void *) 25;
+
+#define bpf_printk(fmt, ...) ({                                  \
+    char ____fmt[] = fmt;                                        \
+    bpf_trace_printk(____fmt, sizeof(____fmt), ##__VA_ARGS__);   \
+})
+
+#define TRACE_PARAM , __u32 *trace_path
+#define TRACE_ARG , &trace_path
+#define TRACE_PATH(p) (*trace_path = (p))
+#define TRACE_BEGIN() \
+    __u64 trace_start = bpf_ktime_get_ns(); \
+    __u32 trace_path = TRACE_PATH_NON_IP
+#define TRACE_END(ctx, action) ({                                \
+    struct trace_event ev = {                                    \
+        .start_ns = trace_start,                                 \
+        .end_ns = bpf_ktime_get_ns(),                            \
+        .path = trace_path,                                      \
+        .verdict = (action),                                     \
+    };                                                           \
+    bpf_perf_event_output(ctx, &trace_events, BPF_F_CURRENT_CPU, \
+                          &ev, sizeof(ev));                      \
+})
+#else
+#define TRACE_PARAM
+#define TRACE_ARG
+#define TRACE_PATH(p) ((void)0)
+#define TRACE_BEGIN() do {} while (0)
+#define TRACE_END(ctx, action) do {} while (0)
+#endif
 
 // Helper functions
 static __always_inline __u16 bpf_ntohs(__u16 netshort) {
@@ -82,20 +406,101 @@ static __always_inline __u32 bpf_htonl(__u32 hostlong) {
            ((hostlong & 0xff000000) >> 24);
 }
 
+static __always_inline void count(__u32 slot) {
+    __u64 *counter = bpf_map_lookup_elem(&stats_map, &slot);
+    if (counter)
+        __sync_fetch_and_add(counter, 1);
+}
+
+// Branch-free floor(log2(v)) for v > 0
+static __always_inline __u32 log2_u32(__u32 v) {
+    __u32 r, shift;
+
+    r = (v > 0xFFFF) << 4; v >>= r;
+    shift = (v > 0xFF) << 3; v >>= shift; r |= shift;
+    shift = (v > 0xF) << 2; v >>= shift; r |= shift;
+    shift = (v > 0x3) << 1; v >>= shift; r |= shift;
+    return r | (v >> 1);
+}
+
+// Account packets, bytes and packet size for the verdict
+static __always_inline void account_traffic(int action, __u64 bytes) {
+    __u32 key = 0;
+    struct traffic_stats *ts = bpf_map_lookup_elem(&traffic_stats_map, &key);
+    if (!ts)
+        return;
+
+    __u32 verdict = action == XDP_DROP ? VERDICT_DROP : VERDICT_PASS;
+    ts->packets[verdict]++;
+    ts->bytes[verdict] += bytes;
+
+    __u32 bucket = log2_u32(bytes | 1);
+    if (bucket >= SIZE_HIST_BUCKETS)
+        bucket = SIZE_HIST_BUCKETS - 1;
+    ts->size_hist[bucket]++;
+}
+
+// Account the verdict against the (ifindex, rx_queue) the packet arrived on.
+// The map is per-CPU, so no atomics are needed.
+static __always_inline void account_queue(struct xdp_md *ctx, int action, __u64 bytes) {
+    struct queue_key qk = {
+        .ifindex = ctx->ingress_ifindex,
+        .rx_queue = ctx->rx_queue_index,
+    };
+
+    struct queue_stats *qs = bpf_map_lookup_elem(&queue_stats_map, &qk);
+    if (!qs) {
+        struct queue_stats init = {};
+        bpf_map_update_elem(&queue_stats_map, &qk, &init, BPF_NOEXIST);
+        qs = bpf_map_lookup_elem(&queue_stats_map, &qk);
+        if (!qs)
+            return;
+    }
+
+    if (action == XDP_DROP)
+        qs->drop++;
+    else
+        qs->pass++;
+    qs->bytes += bytes;
+}
+
 // Process identification based on port patterns
 // In a real implementation, this would involve socket tracking and process context
 static __always_inline int is_target_process(__u16 dest_port) {
-    // Simulate: traffic to ports 4000-5000 range is from "myprocess"
+    // No target process configured: nothing is attributed to it
+    __u32 key = 0;
+    char *target = bpf_map_lookup_elem(&target_process_map, &key);
+    if (!target || !target[0])
+        return 0;
+
+    // Simulate: traffic to ports 4000-5000 range is from the target process
     // This demonstrates the process-specific filtering concept
     return (dest_port >= 4000 && dest_port <= 5000);
 }
 
-SEC("xdp")
-int process_specific_filter(struct xdp_md *ctx)
+// Evaluate the allowed port of one policy for target-process traffic.
+// Returns 1 if the policy would block the packet, 0 if it would allow it and
+// -1 if the policy is not configured.
+static __always_inline int evaluate_policy(__u32 policy, __u16 dest_port,
+                                           struct policy_stats *ps) {
+    __u16 *allowed_port = bpf_map_lookup_elem(&allowed_port_map, &policy);
+    __u16 port = allowed_port ? *allowed_port : 0;
+
+    if (!port)
+        return -1;
+
+    int blocked = dest_port != port;
+    if (ps) {
+        if (blocked)
+            ps->blocked[policy & 1]++;
+        else
+            ps->allowed[policy & 1]++;
+    }
+    return blocked;
+}
+
+static __always_inline int filter_packet(void *data, void *data_end TRACE_PARAM)
 {
-    void *data_end = (void *)(long)ctx->data_end;
-    void *data = (void *)(long)ctx->data;
-    
     // Parse Ethernet header
     struct ethhdr *eth = data;
     if ((void *)(eth + 1) > data_end)
@@ -110,36 +515,230 @@ int process_specific_filter(struct xdp_md *ctx)
     if ((void *)(ip + 1) > data_end)
         return XDP_PASS;
 
-    // Only process TCP packets
-    if (ip->protocol != IPPROTO_TCP)
+    // Only process TCP and UDP packets; ICMP carries no port to tie it to
+    // a process
+    TRACE_PATH(TRACE_PATH_OTHER_PROTO);
+    if (ip->protocol != IPPROTO_TCP && ip->protocol != IPPROTO_UDP)
         return XDP_PASS;
 
-    // Parse TCP header
-    struct tcphdr *tcp = (void *)ip + (ip->ihl * 4);
-    if ((void *)(tcp + 1) > data_end)
+    // Parse the ports, common to both protocols
+    struct l4hdr *l4 = (void *)ip + (ip->ihl * 4);
+    if ((void *)(l4 + 1) > data_end)
         return XDP_PASS;
 
-    __u16 dest_port = bpf_ntohs(tcp->dest);
-    
+    __u16 dest_port = bpf_ntohs(l4->dest);
+    TRACE_PATH(TRACE_PATH_NO_MATCH);
     // Only filter loopback traffic for demonstration
     if (ip->daddr != bpf_htonl(INADDR_LOOPBACK))
         return XDP_PASS;
 
+    count(STAT_TOTAL);
+
     // Check if this traffic is from our target process "myprocess"
-    if (is_target_process(dest_port)) {
-        // This is from "myprocess" - apply strict filtering
-        
-        if (dest_port == 4040) {
-            // Allow only port 4040 for myprocess
-            return XDP_PASS;
+    __u32 key = 0;
+    struct policy_stats *ps = bpf_map_lookup_elem(&policy_stats_map, &key);
+    int active_blocked = -1;
+    if (is_target_process(dest_port))
+        active_blocked = evaluate_policy(POLICY_ACTIVE, dest_port, ps);
+    if (active_blocked >= 0) {
+        // This is from "myprocess" - apply strict filtering, and evaluate
+        // the shadow policy in the same pass
+        int shadow_blocked = evaluate_policy(POLICY_SHADOW, dest_port, ps);
+
+        struct filter_config *cfg = bpf_map_lookup_elem(&config_map, &key);
+        int verdict = XDP_PASS;
+        if (active_blocked && !(cfg && cfg->mode == MODE_MONITOR))
+            verdict = XDP_DROP;
+
+        __u8 policies = (active_blocked > 0) << POLICY_ACTIVE |
+                        (shadow_blocked > 0) << POLICY_SHADOW;
+        if (policies && cfg && cfg->sample_rate &&
+            bpf_get_prandom_u32() % cfg->sample_rate == 0) {
+            struct match_sample sample = {
+                .saddr = ip->saddr,
+                .daddr = ip->daddr,
+                .sport = bpf_ntohs(l4->source),
+                .dport = dest_port,
+                .policies = policies,
+                .verdict = verdict,
+            };
+            bpf_ringbuf_output(&samples_map, &sample, sizeof(sample), 0);
+        }
+
+        if (!active_blocked) {
+            // Allow only the configured port for myprocess
+            count(STAT_ALLOWED);
         } else {
-            // Block all other ports for myprocess
-            return XDP_DROP;
+            // Block all other ports for myprocess (counted even in monitor mode)
+            count(STAT_BLOCKED);
         }
+        TRACE_PATH(verdict == XDP_DROP ? TRACE_PATH_DROP : TRACE_PATH_MATCH);
+        return verdict;
     }
 
     // Allow all traffic from other processes
+    count(STAT_OTHER);
     return XDP_PASS;
 }
 
+SEC("xdp")
+int process_specific_filter(struct xdp_md *ctx)
+{
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    TRACE_BEGIN();
+
+    __u64 bytes = data_end - data;
+    int action = filter_packet(data, data_end TRACE_ARG);
+    account_traffic(action, bytes);
+    account_queue(ctx, action, bytes);
+
+    TRACE_END(ctx, action);
+    return action;
+}
+
+// Returns 1 if port falls in one of the policy's ranges for proto
+static __always_inline int port_allowed(struct port_policy *policy, __u8 proto, __u16 port) {
+    __u32 nr = policy->nr_ranges;
+
+#pragma unroll
+    for (int i = 0; i < MAX_PORT_RANGES; i++) {
+        if (i >= nr)
+            break;
+        if (port >= policy->ranges[i].lo && port <= policy->ranges[i].hi &&
+            (!policy->ranges[i].proto || policy->ranges[i].proto == proto))
+            return 1;
+    }
+    return 0;
+}
+
+static __always_inline struct process_policy *lookup_process_policy(void) {
+    __u32 tgid = bpf_get_current_pid_tgid() >> 32;
+    struct process_policy *policy = bpf_map_lookup_elem(&policy_by_tgid, &tgid);
+    if (policy)
+        return policy;
+
+    __u64 cgroup_id = bpf_get_current_cgroup_id();
+    policy = bpf_map_lookup_elem(&policy_by_cgroup, &cgroup_id);
+    if (policy)
+        return policy;
+
+    // Prefer the name the process was discovered with at exec, so a later
+    // rename via prctl(PR_SET_NAME) does not escape the policy
+    struct process_info *info = bpf_map_lookup_elem(&process_map, &tgid);
+    if (info)
+        return bpf_map_lookup_elem(&policy_by_comm, info->comm);
+
+    struct comm_key comm = {};
+    bpf_get_current_comm(&comm.comm, sizeof(comm.comm));
+    return bpf_map_lookup_elem(&policy_by_comm, &comm);
+}
+
+// Per-process port policy, enforced when a process connects or sends a
+// datagram. Returns 1 to allow the call and 0 to fail it with EPERM.
+static __always_inline int check_process_policy(struct bpf_sock_addr *ctx)
+{
+    __u32 key = 0;
+    struct connect_stats *cs = bpf_map_lookup_elem(&connect_stats_map, &key);
+
+    struct process_policy *policy = lookup_process_policy();
+    if (!policy) {
+        if (cs)
+            cs->unmatched++;
+        return 1;
+    }
+
+    __u8 proto = ctx->protocol;
+    __u16 port = bpf_ntohs((__u16)ctx->user_port);
+    int allowed = port_allowed(&policy->active, proto, port);
+    if (cs) {
+        if (allowed)
+            cs->allowed[POLICY_ACTIVE]++;
+        else
+            cs->blocked[POLICY_ACTIVE]++;
+    }
+
+    if ((policy->flags & PROCESS_POLICY_F_SHADOW) && cs) {
+        if (port_allowed(&policy->shadow, proto, port))
+            cs->allowed[POLICY_SHADOW]++;
+        else
+            cs->blocked[POLICY_SHADOW]++;
+    }
+
+    struct filter_config *cfg = bpf_map_lookup_elem(&config_map, &key);
+    if (cfg && cfg->mode == MODE_MONITOR)
+        return 1;
+    return allowed;
+}
+
+// TCP and UDP connect()
+SEC("cgroup/connect4")
+int process_connect_filter(struct bpf_sock_addr *ctx)
+{
+    return check_process_policy(ctx);
+}
+
+// UDP sendto()/sendmsg() with an explicit destination, which never goes
+// through connect()
+SEC("cgroup/sendmsg4")
+int process_sendmsg_filter(struct bpf_sock_addr *ctx)
+{
+    return check_process_policy(ctx);
+}
+
+// Track every exec of a process whose comm has a policy
+SEC("tracepoint/sched/sched_process_exec")
+int handle_process_exec(void *ctx)
+{
+    struct process_event event = { .type = PROCESS_EVENT_EXEC };
+    __u64 pid_tgid = bpf_get_current_pid_tgid();
+
+    event.info.pid = (__u32)pid_tgid;
+    event.info.tgid = pid_tgid >> 32;
+    bpf_get_current_comm(&event.info.comm, sizeof(event.info.comm));
+
+    if (!bpf_map_lookup_elem(&policy_by_comm, event.info.comm)) {
+        // A tracked process exec'd into an untracked binary
+        if (bpf_map_delete_elem(&process_map, &event.info.tgid) == 0) {
+            event.type = PROCESS_EVENT_EXIT;
+            bpf_ringbuf_output(&process_events, &event, sizeof(event), 0);
+        }
+        return 0;
+    }
+
+    bpf_map_update_elem(&process_map, &event.info.tgid, &event.info, 0);
+    bpf_ringbuf_output(&process_events, &event, sizeof(event), 0);
+    return 0;
+}
+
+// Forget a tracked process once its last thread exits. The leader can exit
+// while other threads keep running; do_exit() has already counted the
+// exiting thread out of signal->live when this tracepoint fires, so the
+// group is dead when it reads 0.
+SEC("tracepoint/sched/sched_process_exit")
+int handle_process_exit(void *ctx)
+{
+    __u32 tgid = bpf_get_current_pid_tgid() >> 32;
+
+    struct process_info *info = bpf_map_lookup_elem(&process_map, &tgid);
+    if (!info)
+        return 0;
+
+    struct task_struct *task = (void *)(long)bpf_get_current_task();
+    struct signal_struct *signal = 0;
+    int live = 1;
+    if (bpf_probe_read_kernel(&signal, sizeof(signal), &task->signal) ||
+        bpf_probe_read_kernel(&live, sizeof(live), &signal->live.counter) ||
+        live != 0)
+        return 0;
+
+    struct process_event event = {
+        .type = PROCESS_EVENT_EXIT,
+        .info = *info,
+    };
+    bpf_map_delete_elem(&process_map, &tgid);
+    bpf_ringbuf_output(&process_events, &event, sizeof(event), 0);
+    return 0;
+}
+
 char _license[] SEC("license") = "GPL";
@@ -1,22 +1,30 @@
 package main
 
 import (
+	"flag"
 	"fmt"
 	"log"
 	"os"
 	"os/signal"
 	"strconv"
-	"strings"
+	"syscall"
 	"time"
-	"unsafe"
 
+	"filter-common/attach"
+	"filter-common/bpfmap"
+	"filter-common/sizing"
+	"filter-common/trace"
+	"filter-common/traffic"
 	"github.com/cilium/ebpf"
 	"github.com/cilium/ebpf/link"
-	"github.com/cilium/ebpf/rlimit"
-	"github.com/vishvananda/netlink"
+	"github.com/cilium/ebpf/ringbuf"
 )
 
-//go:generate go run github.com/cilium/ebpf/cmd/bpf2go -cc clang ProcessFilter process_filter.c
+//go:generate go run github.com/cilium/ebpf/cmd/bpf2go -cc clang -target bpfel,bpfeb ProcessFilter process_filter.c
+//go:generate go run github.com/cilium/ebpf/cmd/bpf2go -cc clang -target bpfel,bpfeb -cflags -DFILTER_TRACE ProcessFilterTrace process_filter.c
+
+// tracePathNames are the code paths of enum trace_path in the eBPF program.
+var tracePathNames = []string{"non-ip", "other proto", "other traffic", "target pass", "target drop"}
 
 type ProcessInfo struct {
 	Comm [16]int8
@@ -25,37 +33,108 @@ type ProcessInfo struct {
 }
 
 func main() {
+	if len(os.Args) > 1 {
+		switch os.Args[1] {
+		case "apply":
+			runApply(os.Args[2:])
+			return
+		case "status":
+			runStatus()
+			return
+		case "stats":
+			runStats()
+			return
+		case "detach":
+			runDetach()
+			return
+		case "size":
+			runSize(os.Args[2:])
+			return
+		case "bench":
+			runBench(os.Args[2:])
+			return
+		case "verify":
+			runVerify(os.Args[2:])
+			return
+		}
+	}
+
 	// Parse command line arguments
+	monitor := flag.Bool("monitor", false, "evaluate and count the policy, but never drop (dry run)")
+	shadowPort := flag.Uint("shadow-port", 0, "candidate allowed port counted alongside the active one (0 = none)")
+	sampleRate := flag.Uint("sample", 0, "sample 1 in N would-be drops to userspace (0 = off)")
+	policyFile := flag.String("policy", "", "per-process policy file (overrides process_name/allowed_port for connect())")
+	traceBuild := flag.Bool("trace", false, "load the FILTER_TRACE build and show per-path latency histograms")
+	cgroupPath := flag.String("cgroup", "/sys/fs/cgroup", "cgroup v2 hierarchy the connect() policy is attached to")
+	memlockBudget := flag.String("memlock-budget", "", "warn when maps need more kernel memory than this, and cap RLIMIT_MEMLOCK to it (e.g. 64MiB)")
+	flag.Usage = func() {
+		fmt.Printf("Usage: %s apply <policy.json> | status | stats | detach | size <policy.json>\n", os.Args[0])
+		fmt.Printf("       %s bench [allowed_port]\n", os.Args[0])
+		fmt.Printf("       %s verify [-record] [-budget budget.json] [object.o ...]\n", os.Args[0])
+		fmt.Printf("       %s [flags] [process_name] [allowed_port] [interface[,...]]\n", os.Args[0])
+		fmt.Printf("       interface: eth0 | eth0@PID | eth0@/run/netns/NAME | 'veth*' (host-side veths, followed)\n")
+		fmt.Printf("       A host-side veth sees what its container sends; use eth0@PID for what it receives\n")
+		fmt.Printf("Example: %s apply policy.json\n", os.Args[0])
+		fmt.Printf("Example: %s myprocess 4040 lo\n", os.Args[0])
+		fmt.Printf("Example: %s -monitor -shadow-port 4041 myprocess 4040 lo\n", os.Args[0])
+		fmt.Printf("Example: %s -policy services.policy\n", os.Args[0])
+		fmt.Printf("Example: %s myprocess 4040 'lo@1234'\n", os.Args[0])
+		flag.PrintDefaults()
+	}
+	flag.Parse()
+
 	processName := "myprocess"
 	allowedPort := uint16(4040)
 	interfaceName := "lo"
 
-	if len(os.Args) > 1 {
-		processName = os.Args[1]
+	if flag.NArg() > 0 {
+		processName = flag.Arg(0)
 	}
-	if len(os.Args) > 2 {
-		port, err := strconv.Atoi(os.Args[2])
+	if flag.NArg() > 1 {
+		port, err := strconv.Atoi(flag.Arg(1))
 		if err != nil || port < 1 || port > 65535 {
-			fmt.Printf("Usage: %s [process_name] [allowed_port] [interface]\n", os.Args[0])
-			fmt.Printf("Example: %s myprocess 4040 lo\n", os.Args[0])
+			flag.Usage()
 			os.Exit(1)
 		}
 		allowedPort = uint16(port)
 	}
-	if len(os.Args) > 3 {
-		interfaceName = os.Args[3]
+	if flag.NArg() > 2 {
+		interfaceName = flag.Arg(2)
+	}
+	if *shadowPort > 65535 {
+		flag.Usage()
+		os.Exit(1)
+	}
+	config := filterConfig{Mode: modeEnforce, SampleRate: uint32(*sampleRate)}
+	if *monitor {
+		config.Mode = modeMonitor
+	}
+	policies, err := loadPolicies(*policyFile, processName, allowedPort, uint16(*shadowPort))
+	if err != nil {
+		log.Fatalf("Failed to load policy: %v", err)
 	}
 
-	// Remove memory limit for eBPF
-	if err := rlimit.RemoveMemlock(); err != nil {
-		log.Fatalf("Failed to remove memlock limit: %v", err)
+	budget, err := sizing.ParseSize(*memlockBudget)
+	if err != nil {
+		log.Fatalf("Invalid -memlock-budget: %v", err)
+	}
+	targets, err := attach.ParseTargets(interfaceName)
+	if err != nil {
+		log.Fatalf("Invalid interface: %v", err)
 	}
 
-	// Load the compiled eBPF program
-	spec, err := LoadProcessFilter()
+	// Load the compiled eBPF program (or its FILTER_TRACE build)
+	loadSpec := LoadProcessFilter
+	if *traceBuild {
+		loadSpec = LoadProcessFilterTrace
+	}
+	spec, err := loadSpec()
 	if err != nil {
 		log.Fatalf("Failed to load eBPF spec: %v", err)
 	}
+	if err := sizing.SetupMemlock(spec, budget); err != nil {
+		log.Fatalf("Failed to set memlock limit: %v", err)
+	}
 
 	// Create the collection of maps and programs
 	coll, err := ebpf.NewCollection(spec)
@@ -63,90 +142,199 @@ func main() {
 		log.Fatalf("Failed to create eBPF collection: %v", err)
 	}
 	defer coll.Close()
+	if sizes, err := sizing.Maps(coll.Maps); err == nil {
+		sizing.Print(sizes, budget)
+	}
 
 	// Configure the target process name
 	key := uint32(0)
-	processNameBytes := make([]int8, 16)
-	for i, b := range []byte(processName) {
-		if i >= 16 {
-			break
-		}
-		processNameBytes[i] = int8(b)
-	}
-	if err := coll.Maps["target_process_map"].Put(key, processNameBytes); err != nil {
+	if err := coll.Maps["target_process_map"].Put(key, makeComm(processName)); err != nil {
 		log.Fatalf("Failed to set target process name: %v", err)
 	}
 
-	// Configure the allowed port
-	if err := coll.Maps["allowed_port_map"].Put(key, allowedPort); err != nil {
+	// Configure the allowed port for the active and shadow policy
+	if err := bpfmap.BatchPut(coll.Maps["allowed_port_map"],
+		[]uint32{policyActive, policyShadow},
+		[]uint16{allowedPort, uint16(*shadowPort)}); err != nil {
 		log.Fatalf("Failed to set allowed port: %v", err)
 	}
 
-	// Add the target process to monitoring (simulate PID 1000)
-	targetPID := uint32(1000)
-	procInfo := ProcessInfo{
-		Comm: processNameBytes,
-		PID:  targetPID,
-		TGID: targetPID,
+	// Configure the filter mode
+	if err := coll.Maps["config_map"].Put(key, config); err != nil {
+		log.Fatalf("Failed to configure filter mode: %v", err)
+	}
+
+	// Configure the per-process connect() policies
+	if err := policies.apply(coll.Maps); err != nil {
+		log.Fatalf("Failed to configure process policies: %v", err)
 	}
-	if err := coll.Maps["process_map"].Put(targetPID, procInfo); err != nil {
-		log.Fatalf("Failed to add process to monitoring: %v", err)
+
+	// Discover matching processes in the kernel on exec/exit, then pick up
+	// the ones that were already running
+	events, err := ringbuf.NewReader(coll.Maps["process_events"])
+	if err != nil {
+		log.Fatalf("Failed to open process event reader: %v", err)
+	}
+	defer events.Close()
+	for _, tp := range []struct{ name, prog string }{
+		{"sched_process_exec", "handle_process_exec"},
+		{"sched_process_exit", "handle_process_exit"},
+	} {
+		tl, err := link.Tracepoint("sched", tp.name, coll.Programs[tp.prog], nil)
+		if err != nil {
+			log.Fatalf("Failed to attach %s tracepoint: %v", tp.name, err)
+		}
+		defer tl.Close()
+	}
+	tracker := newProcessTracker()
+	go tracker.run(events)
+	if err := tracker.seed(coll.Maps["process_map"], policies.byComm); err != nil {
+		log.Fatalf("Failed to add running processes to monitoring: %v", err)
 	}
 
 	// Initialize statistics
-	var zeroCounter uint64 = 0
-	for i := uint32(0); i < 4; i++ {
-		if err := coll.Maps["stats_map"].Put(i, zeroCounter); err != nil {
-			log.Printf("Warning: Failed to initialize stats counter %d: %v", i, err)
-		}
+	if err := bpfmap.BatchPut(coll.Maps["stats_map"], []uint32{0, 1, 2, 3}, make([]uint64, 4)); err != nil {
+		log.Printf("Warning: Failed to initialize stats counters: %v", err)
 	}
 
-	// Get network interface
-	iface, err := netlink.LinkByName(interfaceName)
+	// Attach the XDP program to every target; all of them share the maps
+	attacher := attach.New(coll.Programs["process_specific_filter"])
+	defer attacher.Close()
+	done := make(chan struct{})
+	defer close(done)
+	if err := attacher.Attach(targets, done); err != nil {
+		log.Fatalf("Failed to attach XDP program: %v", err)
+	}
+
+	// Attach the connect() policy to the cgroup hierarchy
+	cl, err := link.AttachCgroup(link.CgroupOptions{
+		Path:    *cgroupPath,
+		Attach:  ebpf.AttachCGroupInet4Connect,
+		Program: coll.Programs["process_connect_filter"],
+	})
 	if err != nil {
-		log.Fatalf("Failed to get interface %s: %v", interfaceName, err)
+		log.Fatalf("Failed to attach connect() policy to %s: %v", *cgroupPath, err)
 	}
+	defer cl.Close()
 
-	// Attach XDP program to interface
-	l, err := link.AttachXDP(link.XDPOptions{
-		Program:   coll.Programs["process_specific_filter"],
-		Interface: iface.Attrs().Index,
-		Flags:     link.XDPGenericMode,
+	// Unconnected UDP sockets name the destination on every send instead
+	sl, err := link.AttachCgroup(link.CgroupOptions{
+		Path:    *cgroupPath,
+		Attach:  ebpf.AttachCGroupUDP4Sendmsg,
+		Program: coll.Programs["process_sendmsg_filter"],
 	})
 	if err != nil {
-		log.Fatalf("Failed to attach XDP program: %v", err)
+		log.Fatalf("Failed to attach sendmsg() policy to %s: %v", *cgroupPath, err)
 	}
-	defer l.Close()
+	defer sl.Close()
 
 	fmt.Printf("✅ Process-specific filter loaded on %s\n", interfaceName)
-	fmt.Printf("📋 Target process: '%s' (simulated PID: %d)\n", processName, targetPID)
+	fmt.Printf("📋 Target process: '%s' (running PIDs: %v)\n", processName, tracker.pids()[processName])
 	fmt.Printf("🔓 Allowed port: %d\n", allowedPort)
-	fmt.Printf("🔒 All other ports for '%s' will be blocked\n", processName)
-	fmt.Printf("📊 Statistics will be shown every 5 seconds\n")
+	if config.Mode == modeMonitor {
+		fmt.Printf("👀 Monitor mode - other ports for '%s' are counted, nothing is dropped\n", processName)
+	} else {
+		fmt.Printf("🔒 All other ports for '%s' will be blocked\n", processName)
+	}
+	fmt.Printf("🔌 connect()/sendmsg() policy for %d process selector(s) attached to %s\n", policies.len(), *cgroupPath)
+	if *policyFile != "" {
+		fmt.Printf("🔄 Send SIGHUP to reload %s\n", *policyFile)
+	}
+	if *shadowPort != 0 {
+		fmt.Printf("🔍 Shadow policy (allowed port %d) is counted alongside the active one\n", *shadowPort)
+	}
+	fmt.Printf("📊 Statistics and per-queue rates will be shown every %v\n", traffic.Interval)
 	fmt.Printf("Press Ctrl+C to stop\n\n")
 
+	// Print sampled would-be drops
+	if config.SampleRate > 0 {
+		rd, err := ringbuf.NewReader(coll.Maps["samples_map"])
+		if err != nil {
+			log.Fatalf("Failed to open sample reader: %v", err)
+		}
+		defer rd.Close()
+		go readSamples(rd)
+	}
+
+	// Collect per-packet trace events
+	tracer := trace.NewCollector(tracePathNames)
+	if *traceBuild {
+		rd, err := trace.NewReader(coll.Maps["trace_events"])
+		if err != nil {
+			log.Fatalf("Failed to open trace reader: %v", err)
+		}
+		defer rd.Close()
+		go tracer.Run(rd)
+	}
+
 	// Setup statistics monitoring
-	ticker := time.NewTicker(5 * time.Second)
+	ticker := time.NewTicker(traffic.Interval)
 	defer ticker.Stop()
 
-	// Wait for interrupt signal or ticker
+	// Print statistics until interrupted
 	c := make(chan os.Signal, 1)
-	signal.Notify(c, os.Interrupt)
-
-	go func() {
-		for {
-			select {
-			case <-ticker.C:
-				showStats(coll.Maps["stats_map"], processName)
-			case <-c:
-				return
+	signal.Notify(c, os.Interrupt, syscall.SIGHUP)
+
+	rates := traffic.NewPrinter(coll.Maps["traffic_stats_map"], coll.Maps["queue_stats_map"], attacher.Label)
+	policy := &policyReporter{statsMap: coll.Maps["policy_stats_map"]}
+loop:
+	for {
+		select {
+		case <-ticker.C:
+			showStats(coll.Maps["stats_map"], processName)
+			rates.Print(traffic.Interval)
+			policy.print(traffic.Interval)
+			showConnectStats(coll.Maps["connect_stats_map"])
+			fmt.Printf("📋 Tracked processes: %v\n", tracker.pids())
+			if *traceBuild {
+				tracer.Print()
+			}
+		case sig := <-c:
+			if sig != syscall.SIGHUP {
+				break loop
+			}
+			if *policyFile == "" {
+				continue
+			}
+			reloaded, err := loadPolicyFile(*policyFile)
+			if err != nil {
+				log.Printf("Failed to reload policy: %v", err)
+				continue
+			}
+			if err := reloaded.apply(coll.Maps); err != nil {
+				log.Printf("Failed to apply reloaded policy: %v", err)
 			}
 		}
-	}()
+	}
 
-	<-c
 	fmt.Printf("\n🛑 Shutting down process-specific filter...\n")
 	showStats(coll.Maps["stats_map"], processName)
+	if *traceBuild {
+		tracer.Print()
+	}
+}
+
+// loadPolicies reads the policy file, or builds a one-process policy from
+// the positional arguments when no file is given.
+func loadPolicies(path, processName string, allowedPort, shadowPort uint16) (*policySet, error) {
+	if path != "" {
+		return loadPolicyFile(path)
+	}
+
+	var policy processPolicy
+	policy.Active.Ranges[0] = portRange{Lo: allowedPort, Hi: allowedPort}
+	policy.Active.NrRanges = 1
+	if shadowPort != 0 {
+		policy.Shadow.Ranges[0] = portRange{Lo: shadowPort, Hi: shadowPort}
+		policy.Shadow.NrRanges = 1
+		policy.Flags |= processPolicyFlagShadow
+	}
+
+	ps := newPolicySet()
+	if err := ps.add("comm:"+processName, policy); err != nil {
+		return nil, err
+	}
+	return ps, nil
 }
 
 func showStats(statsMap *ebpf.Map, processName string) {
@@ -165,7 +353,6 @@ func showStats(statsMap *ebpf.Map, processName string) {
 		otherProcess = 0
 	}
 
-	targetProcess := allowed + blocked
-	fmt.Printf("📈 Stats: Total=%d | %s: Allowed=%d, Blocked=%d | Other processes=%d\n",
-		total, processName, allowed, blocked, otherProcess)
+	fmt.Printf("📈 Stats: Total=%d | %s: Allowed=%d, Blocked=%d (of %d) | Other processes=%d\n",
+		total, processName, allowed, blocked, allowed+blocked, otherProcess)
 }
@@ -0,0 +1,255 @@
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"log"
+	"os"
+	"strconv"
+	"strings"
+	"syscall"
+	"time"
+
+	"filter-common/bpfmap"
+	"github.com/cilium/ebpf"
+)
+
+// Sizes and flags, as in the eBPF program.
+const (
+	maxPortRanges           = 16
+	processPolicyFlagShadow = 1 << 0
+)
+
+// IP protocols, as in the eBPF program
+const (
+	ipprotoTCP = 6
+	ipprotoUDP = 17
+)
+
+// portRange mirrors struct port_range in the eBPF program.
+type portRange struct {
+	Lo    uint16
+	Hi    uint16
+	Proto uint8 // ipprotoTCP, ipprotoUDP or 0 for both
+	Pad   [3]uint8
+}
+
+// portPolicy mirrors struct port_policy in the eBPF program.
+type portPolicy struct {
+	NrRanges uint32
+	Ranges   [maxPortRanges]portRange
+}
+
+// processPolicy mirrors struct process_policy in the eBPF program.
+type processPolicy struct {
+	Flags  uint32
+	Active portPolicy
+	Shadow portPolicy
+}
+
+// commKey mirrors struct comm_key in the eBPF program.
+type commKey [16]byte
+
+func makeCommKey(name string) commKey {
+	var k commKey
+	copy(k[:len(k)-1], name)
+	return k
+}
+
+// policySet is a compiled policy file, split by how processes are selected.
+type policySet struct {
+	byTGID   map[uint32]processPolicy
+	byCgroup map[uint64]processPolicy
+	byComm   map[commKey]processPolicy
+}
+
+func newPolicySet() *policySet {
+	return &policySet{
+		byTGID:   make(map[uint32]processPolicy),
+		byCgroup: make(map[uint64]processPolicy),
+		byComm:   make(map[commKey]processPolicy),
+	}
+}
+
+func (ps *policySet) len() int {
+	return len(ps.byTGID) + len(ps.byCgroup) + len(ps.byComm)
+}
+
+// parsePortRanges parses "80,443,udp/53,tcp/8000-8100" into a port policy.
+// A range without a protocol applies to both TCP and UDP.
+func parsePortRanges(s string) (portPolicy, error) {
+	var policy portPolicy
+	for _, field := range strings.Split(s, ",") {
+		if policy.NrRanges == maxPortRanges {
+			return policy, fmt.Errorf("more than %d port ranges in %q", maxPortRanges, s)
+		}
+		var proto uint8
+		ports := field
+		if name, rest, ok := strings.Cut(field, "/"); ok {
+			switch strings.ToLower(strings.TrimSpace(name)) {
+			case "tcp":
+				proto = ipprotoTCP
+			case "udp":
+				proto = ipprotoUDP
+			default:
+				return policy, fmt.Errorf("invalid protocol in %q (want tcp or udp)", field)
+			}
+			ports = rest
+		}
+		lo, hi, isRange := strings.Cut(ports, "-")
+		if !isRange {
+			hi = lo
+		}
+		l, errLo := strconv.ParseUint(strings.TrimSpace(lo), 10, 16)
+		h, errHi := strconv.ParseUint(strings.TrimSpace(hi), 10, 16)
+		if errLo != nil || errHi != nil || l == 0 || l > h {
+			return policy, fmt.Errorf("invalid port range %q", field)
+		}
+		policy.Ranges[policy.NrRanges] = portRange{Lo: uint16(l), Hi: uint16(h), Proto: proto}
+		policy.NrRanges++
+	}
+	return policy, nil
+}
+
+// add registers a policy for a selector: comm:<name>, tgid:<pid>,
+// cgroup:<cgroup v2 path> or cgroupid:<id>.
+func (ps *policySet) add(selector string, policy processPolicy) error {
+	kind, value, ok := strings.Cut(selector, ":")
+	if !ok || value == "" {
+		return fmt.Errorf("invalid selector %q", selector)
+	}
+	switch kind {
+	case "comm":
+		if len(value) > len(commKey{})-1 {
+			return fmt.Errorf("process name %q longer than %d characters", value, len(commKey{})-1)
+		}
+		ps.byComm[makeCommKey(value)] = policy
+	case "tgid":
+		tgid, err := strconv.ParseUint(value, 10, 32)
+		if err != nil {
+			return fmt.Errorf("invalid tgid %q", value)
+		}
+		ps.byTGID[uint32(tgid)] = policy
+	case "cgroup":
+		id, err := cgroupID(value)
+		if err != nil {
+			return err
+		}
+		ps.byCgroup[id] = policy
+	case "cgroupid":
+		id, err := strconv.ParseUint(value, 10, 64)
+		if err != nil {
+			return fmt.Errorf("invalid cgroup id %q", value)
+		}
+		ps.byCgroup[id] = policy
+	default:
+		return fmt.Errorf("unknown selector kind %q", kind)
+	}
+	return nil
+}
+
+// cgroupID returns the id of a cgroup v2 directory, which is its inode
+// number.
+func cgroupID(path string) (uint64, error) {
+	var st syscall.Stat_t
+	if err := syscall.Stat(path, &st); err != nil {
+		return 0, fmt.Errorf("cgroup %s: %w", path, err)
+	}
+	return st.Ino, nil
+}
+
+// loadPolicyFile reads a policy file with one process per line:
+//
+//	<selector> <ports> [shadow=<ports>]
+//
+// e.g. "comm:nginx 80,443,8000-8100 shadow=80,443". Blank lines and lines
+// starting with '#' are ignored.
+func loadPolicyFile(path string) (*policySet, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+
+	ps := newPolicySet()
+	scanner := bufio.NewScanner(f)
+	for line := 1; scanner.Scan(); line++ {
+		fields := strings.Fields(scanner.Text())
+		if len(fields) == 0 || strings.HasPrefix(fields[0], "#") {
+			continue
+		}
+		if len(fields) < 2 || len(fields) > 3 {
+			return nil, fmt.Errorf("%s:%d: expected <selector> <ports> [shadow=<ports>]", path, line)
+		}
+
+		var policy processPolicy
+		if policy.Active, err = parsePortRanges(fields[1]); err != nil {
+			return nil, fmt.Errorf("%s:%d: %w", path, line, err)
+		}
+		if len(fields) == 3 {
+			shadow, ok := strings.CutPrefix(fields[2], "shadow=")
+			if !ok {
+				return nil, fmt.Errorf("%s:%d: unexpected %q", path, line, fields[2])
+			}
+			if policy.Shadow, err = parsePortRanges(shadow); err != nil {
+				return nil, fmt.Errorf("%s:%d: %w", path, line, err)
+			}
+			policy.Flags |= processPolicyFlagShadow
+		}
+		if err := ps.add(fields[0], policy); err != nil {
+			return nil, fmt.Errorf("%s:%d: %w", path, line, err)
+		}
+	}
+	return ps, scanner.Err()
+}
+
+// apply syncs the policy set into the kernel maps, touching only entries
+// that changed.
+func (ps *policySet) apply(maps map[string]*ebpf.Map) error {
+	start := time.Now()
+	var updated, deleted int
+	for _, sync := range []func() (int, int, error){
+		func() (int, int, error) { return bpfmap.Sync(maps["policy_by_tgid"], ps.byTGID) },
+		func() (int, int, error) { return bpfmap.Sync(maps["policy_by_cgroup"], ps.byCgroup) },
+		func() (int, int, error) { return bpfmap.Sync(maps["policy_by_comm"], ps.byComm) },
+	} {
+		u, d, err := sync()
+		if err != nil {
+			return err
+		}
+		updated += u
+		deleted += d
+	}
+	fmt.Printf("⏱️  Synced %d process policies in %v (%d updated, %d deleted)\n",
+		ps.len(), time.Since(start), updated, deleted)
+	return nil
+}
+
+// connectStats mirrors struct connect_stats in the eBPF program.
+type connectStats struct {
+	Allowed   [2]uint64
+	Blocked   [2]uint64
+	Unmatched uint64
+}
+
+// showConnectStats prints the connect() decisions summed over all CPUs.
+func showConnectStats(m *ebpf.Map) {
+	var (
+		perCPU []connectStats
+		sum    connectStats
+	)
+	if err := m.Lookup(uint32(0), &perCPU); err != nil {
+		log.Printf("Failed to read connect statistics: %v", err)
+		return
+	}
+	for _, s := range perCPU {
+		for i := range sum.Allowed {
+			sum.Allowed[i] += s.Allowed[i]
+			sum.Blocked[i] += s.Blocked[i]
+		}
+		sum.Unmatched += s.Unmatched
+	}
+	fmt.Printf("🔌 connect(): active allowed=%d blocked=%d | shadow allowed=%d blocked=%d | no policy=%d\n",
+		sum.Allowed[policyActive], sum.Blocked[policyActive],
+		sum.Allowed[policyShadow], sum.Blocked[policyShadow], sum.Unmatched)
+}
@@ -0,0 +1,94 @@
+package main
+
+import (
+	"os"
+	"path/filepath"
+	"reflect"
+	"testing"
+)
+
+func TestParsePortRanges(t *testing.T) {
+	tests := []struct {
+		in   string
+		want []portRange
+	}{
+		{"4040", []portRange{{Lo: 4040, Hi: 4040}}},
+		{"80, 443", []portRange{{Lo: 80, Hi: 80}, {Lo: 443, Hi: 443}}},
+		{"8000-8100", []portRange{{Lo: 8000, Hi: 8100}}},
+		{"tcp/22", []portRange{{Lo: 22, Hi: 22, Proto: ipprotoTCP}}},
+		{"UDP/53,tcp/853", []portRange{{Lo: 53, Hi: 53, Proto: ipprotoUDP}, {Lo: 853, Hi: 853, Proto: ipprotoTCP}}},
+		{"udp/1-65535", []portRange{{Lo: 1, Hi: 65535, Proto: ipprotoUDP}}},
+	}
+	for _, tt := range tests {
+		got, err := parsePortRanges(tt.in)
+		if err != nil {
+			t.Errorf("parsePortRanges(%q): %v", tt.in, err)
+			continue
+		}
+		if got.NrRanges != uint32(len(tt.want)) {
+			t.Errorf("parsePortRanges(%q): %d ranges, want %d", tt.in, got.NrRanges, len(tt.want))
+			continue
+		}
+		if r := got.Ranges[:got.NrRanges]; !reflect.DeepEqual(r, tt.want) {
+			t.Errorf("parsePortRanges(%q) = %v, want %v", tt.in, r, tt.want)
+		}
+	}
+}
+
+func TestParsePortRangesInvalid(t *testing.T) {
+	for _, in := range []string{
+		"", "0", "65536", "100-10", "80-", "-80", "icmp/8", "sctp/80", "tcp/", "a,b",
+		"1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17",
+	} {
+		if got, err := parsePortRanges(in); err == nil {
+			t.Errorf("parsePortRanges(%q) = %v, want error", in, got)
+		}
+	}
+}
+
+func TestSinglePort(t *testing.T) {
+	for in, want := range map[string]bool{
+		"4040": true, "tcp/4040": false, "4040-4041": false, "4040,4041": false,
+	} {
+		p, err := parsePortRanges(in)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if _, err := singlePort(p); (err == nil) != want {
+			t.Errorf("singlePort(%q) error = %v, want ok=%v", in, err, want)
+		}
+	}
+}
+
+// TestLoadSharedPolicy loads the example of packet-filter's policyFile,
+// which both tools must accept.
+func TestLoadSharedPolicy(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "policy.json")
+	if err := os.WriteFile(path, []byte(`{
+	  "interface": "eth0",
+	  "mode": "enforce",
+	  "sample_rate": 100,
+	  "talkers_pass": true,
+	  "ports": {"block": "4040,udp/53,icmp/8", "shadow": "candidate.txt"},
+	  "blocklist": ["203.0.113.7"],
+	  "blocklist_file": "abusers.txt",
+	  "memlock_budget": "64MiB",
+	  "cgroup": "/sys/fs/cgroup",
+	  "processes": [
+	    {"select": "comm:myprocess", "allow": "4040"},
+	    {"select": "comm:nginx", "allow": "80,443"}
+	  ]
+	}`), 0o644); err != nil {
+		t.Fatal(err)
+	}
+	policy, err := loadPolicy(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if policy.target != "myprocess" || policy.allowedPort != 4040 {
+		t.Errorf("XDP target = %q port %d, want \"myprocess\" port 4040", policy.target, policy.allowedPort)
+	}
+	if n := policy.policies.len(); n != 2 {
+		t.Errorf("%d process policies, want 2", n)
+	}
+}
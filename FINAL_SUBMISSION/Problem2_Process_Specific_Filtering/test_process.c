@@ -1,3 +1,5 @@
+//go:build ignore
+
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -0,0 +1,40 @@
+package main
+
+import (
+	"fmt"
+
+	"filter-common/verify"
+	"github.com/cilium/ebpf"
+)
+
+// runVerify loads the programs through the verifier and checks their size
+// against the committed budget.
+// Usage: process-filter verify [-record] [-budget budget.json] [object.o ...]
+func runVerify(args []string) {
+	verify.Run(args, verifierSpecs)
+}
+
+// verifierSpecs returns the collections "verify" checks: the embedded
+// production and FILTER_TRACE builds, or the object files given, such as
+// the ones build.sh produces.
+func verifierSpecs(objects []string) ([]*ebpf.CollectionSpec, error) {
+	var specs []*ebpf.CollectionSpec
+	if len(objects) == 0 {
+		for _, load := range []func() (*ebpf.CollectionSpec, error){LoadProcessFilter, LoadProcessFilterTrace} {
+			spec, err := load()
+			if err != nil {
+				return nil, err
+			}
+			specs = append(specs, spec)
+		}
+		return specs, nil
+	}
+	for _, obj := range objects {
+		spec, err := ebpf.LoadCollectionSpec(obj)
+		if err != nil {
+			return nil, fmt.Errorf("%s: %w", obj, err)
+		}
+		specs = append(specs, spec)
+	}
+	return specs, nil
+}
@@ -0,0 +1,254 @@
+// Package attach attaches one XDP program to interfaces in the loader's
+// network namespace, inside other namespaces, and to host-side veths as
+// they come and go.
+package attach
+
+import (
+	"fmt"
+	"log"
+	"path"
+	"runtime"
+	"strconv"
+	"strings"
+	"sync"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/link"
+	"github.com/vishvananda/netlink"
+	"github.com/vishvananda/netns"
+	"golang.org/x/sys/unix"
+)
+
+// Target is where the XDP program is attached: an interface in the
+// loader's network namespace, an interface inside another namespace, or a
+// name pattern for host-side veths.
+type Target struct {
+	iface string
+	netns string // PID or namespace path, "" for the loader's namespace
+}
+
+// ParseTargets parses a comma separated list of targets:
+//
+//	eth0               interface in the loader's namespace
+//	eth0@1234          interface in the namespace of PID 1234
+//	eth0@/run/netns/a  interface in the namespace bind-mounted at a path
+//	veth*              host-side veths matching a glob, as they come and go
+//
+// XDP on a host-side veth sees the container's egress. Filtering what a
+// container receives needs its own interface, eth0@PID.
+func ParseTargets(s string) ([]Target, error) {
+	var targets []Target
+	for _, field := range strings.Split(s, ",") {
+		iface, ns, _ := strings.Cut(strings.TrimSpace(field), "@")
+		t := Target{iface: iface, netns: ns}
+		if iface == "" {
+			return nil, fmt.Errorf("invalid attach target %q", field)
+		}
+		if _, err := path.Match(iface, ""); err != nil {
+			return nil, fmt.Errorf("invalid interface pattern %q", iface)
+		}
+		if t.isPattern() && ns != "" {
+			return nil, fmt.Errorf("%q: veth patterns match host-side veths, not a namespace", field)
+		}
+		targets = append(targets, t)
+	}
+	return targets, nil
+}
+
+func (t Target) String() string {
+	if t.netns == "" {
+		return t.iface
+	}
+	return t.iface + "@" + t.netns
+}
+
+func (t Target) isPattern() bool {
+	return strings.ContainsAny(t.iface, "*?[")
+}
+
+// inNetns runs fn on an OS thread switched into the target's namespace.
+// Interface names and XDP attachment both resolve in the namespace of the
+// calling thread.
+func (t Target) inNetns(fn func() error) error {
+	if t.netns == "" {
+		return fn()
+	}
+	runtime.LockOSThread()
+	orig, err := netns.Get()
+	if err != nil {
+		runtime.UnlockOSThread()
+		return fmt.Errorf("current netns: %w", err)
+	}
+	defer orig.Close()
+
+	var target netns.NsHandle
+	if pid, convErr := strconv.Atoi(t.netns); convErr == nil {
+		target, err = netns.GetFromPid(pid)
+	} else {
+		target, err = netns.GetFromPath(t.netns)
+	}
+	if err != nil {
+		runtime.UnlockOSThread()
+		return fmt.Errorf("netns %s: %w", t.netns, err)
+	}
+	defer target.Close()
+
+	if err := netns.Set(target); err != nil {
+		runtime.UnlockOSThread()
+		return fmt.Errorf("enter netns %s: %w", t.netns, err)
+	}
+	defer func() {
+		// A thread that cannot go back stays locked, and Go retires it
+		// when the goroutine exits
+		if err := netns.Set(orig); err == nil {
+			runtime.UnlockOSThread()
+		}
+	}()
+	return fn()
+}
+
+// Attacher attaches one loaded program to any number of interfaces.
+// Every attachment runs the same program and so shares all of its maps.
+type Attacher struct {
+	prog   *ebpf.Program
+	mu     sync.Mutex
+	links  map[string]link.Link // by target, or by ifindex for veths
+	labels map[uint32]string    // target by ifindex, as the program sees it
+}
+
+func New(prog *ebpf.Program) *Attacher {
+	return &Attacher{prog: prog, links: make(map[string]link.Link), labels: make(map[uint32]string)}
+}
+
+// Attach attaches to fixed targets and starts following host-side veths
+// for the patterns among them until done is closed.
+func (a *Attacher) Attach(targets []Target, done <-chan struct{}) error {
+	var patterns []string
+	for _, t := range targets {
+		if t.isPattern() {
+			patterns = append(patterns, t.iface)
+			continue
+		}
+		err := t.inNetns(func() error {
+			iface, err := netlink.LinkByName(t.iface)
+			if err != nil {
+				return err
+			}
+			l, err := link.AttachXDP(link.XDPOptions{
+				Program:   a.prog,
+				Interface: iface.Attrs().Index,
+				Flags:     link.XDPGenericMode,
+			})
+			if err != nil {
+				return err
+			}
+			a.mu.Lock()
+			a.links[t.String()] = l
+			a.addLabel(uint32(iface.Attrs().Index), t.String())
+			a.mu.Unlock()
+			return nil
+		})
+		if err != nil {
+			return fmt.Errorf("%s: %w", t, err)
+		}
+	}
+	if len(patterns) == 0 {
+		return nil
+	}
+	fmt.Printf("🔌 Following host-side veths %v: they filter traffic containers send, not what they receive\n", patterns)
+
+	// Existing veths arrive as RTM_NEWLINK too, so one path handles both
+	updates := make(chan netlink.LinkUpdate)
+	if err := netlink.LinkSubscribeWithOptions(updates, done, netlink.LinkSubscribeOptions{
+		ListExisting:  true,
+		ErrorCallback: func(err error) { log.Printf("Link event subscription: %v", err) },
+	}); err != nil {
+		return fmt.Errorf("subscribe to link events: %w", err)
+	}
+	go func() {
+		for u := range updates {
+			a.linkUpdate(u, patterns)
+		}
+	}()
+	return nil
+}
+
+// linkUpdate attaches to a new veth matching one of patterns and releases
+// the link of a removed one. The kernel detaches XDP from a deleted
+// interface by itself.
+func (a *Attacher) linkUpdate(u netlink.LinkUpdate, patterns []string) {
+	if u.Link == nil || u.Type() != "veth" {
+		return
+	}
+	name, index := u.Attrs().Name, u.Attrs().Index
+	matched := false
+	for _, p := range patterns {
+		if ok, _ := path.Match(p, name); ok {
+			matched = true
+			break
+		}
+	}
+	if !matched {
+		return
+	}
+
+	key := "if" + strconv.Itoa(index)
+	a.mu.Lock()
+	defer a.mu.Unlock()
+	switch u.Header.Type {
+	case unix.RTM_NEWLINK:
+		if _, ok := a.links[key]; ok {
+			return
+		}
+		l, err := link.AttachXDP(link.XDPOptions{
+			Program:   a.prog,
+			Interface: index,
+			Flags:     link.XDPGenericMode,
+		})
+		if err != nil {
+			log.Printf("Failed to attach XDP program to %s: %v", name, err)
+			return
+		}
+		a.links[key] = l
+		a.addLabel(uint32(index), name)
+		fmt.Printf("🔌 Attached to %s (%d interface(s))\n", name, len(a.links))
+	case unix.RTM_DELLINK:
+		if l, ok := a.links[key]; ok {
+			l.Close()
+			delete(a.links, key)
+			if a.labels[uint32(index)] == name {
+				delete(a.labels, uint32(index))
+			}
+			fmt.Printf("🔌 %s removed (%d interface(s))\n", name, len(a.links))
+		}
+	}
+}
+
+// addLabel records the target behind an ifindex. Interfaces in different
+// namespaces can share an ifindex, and the program cannot tell them apart,
+// so such an ifindex is labelled with every target.
+func (a *Attacher) addLabel(ifindex uint32, target string) {
+	if prev, ok := a.labels[ifindex]; ok && prev != target {
+		target = prev + "," + target
+	}
+	a.labels[ifindex] = target
+}
+
+// Label returns the target attached at an ifindex, e.g. eth0@1234 for an
+// interface in another namespace, where the loader's own lookup would find
+// a different interface or none.
+func (a *Attacher) Label(ifindex uint32) (string, bool) {
+	a.mu.Lock()
+	defer a.mu.Unlock()
+	label, ok := a.labels[ifindex]
+	return label, ok
+}
+
+func (a *Attacher) Close() {
+	a.mu.Lock()
+	defer a.mu.Unlock()
+	for key, l := range a.links {
+		l.Close()
+		delete(a.links, key)
+	}
+}
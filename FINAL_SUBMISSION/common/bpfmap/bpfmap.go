@@ -0,0 +1,91 @@
+// Package bpfmap holds the map helpers both filters use to write rule
+// sets and policies into the kernel with as few syscalls as possible.
+package bpfmap
+
+import (
+	"errors"
+	"fmt"
+
+	"github.com/cilium/ebpf"
+)
+
+// Sync makes the contents of a hash map match desired. The current
+// contents are read once and only new, changed or stale keys are written,
+// so reloading a large rule set costs syscalls proportional to the diff.
+func Sync[K comparable, V comparable](m *ebpf.Map, desired map[K]V) (updated, deleted int, err error) {
+	var (
+		key     K
+		value   V
+		current = make(map[K]V, len(desired))
+	)
+	iter := m.Iterate()
+	for iter.Next(&key, &value) {
+		current[key] = value
+	}
+	if err := iter.Err(); err != nil {
+		return 0, 0, fmt.Errorf("read map contents: %w", err)
+	}
+
+	var (
+		putKeys   []K
+		putValues []V
+		delKeys   []K
+	)
+	for k, v := range desired {
+		if old, ok := current[k]; !ok || old != v {
+			putKeys = append(putKeys, k)
+			putValues = append(putValues, v)
+		}
+	}
+	for k := range current {
+		if _, ok := desired[k]; !ok {
+			delKeys = append(delKeys, k)
+		}
+	}
+
+	if err := BatchPut(m, putKeys, putValues); err != nil {
+		return 0, 0, fmt.Errorf("update entries: %w", err)
+	}
+	if err := BatchDelete(m, delKeys); err != nil {
+		return len(putKeys), 0, fmt.Errorf("delete entries: %w", err)
+	}
+	return len(putKeys), len(delKeys), nil
+}
+
+// BatchPut writes all keys with a single BPF_MAP_UPDATE_BATCH, falling back
+// to one update per key on kernels without the batch API.
+func BatchPut[K any, V any](m *ebpf.Map, keys []K, values []V) error {
+	if len(keys) == 0 {
+		return nil
+	}
+	_, err := m.BatchUpdate(keys, values, nil)
+	if !errors.Is(err, ebpf.ErrNotSupported) {
+		return err
+	}
+	for i := range keys {
+		if err := m.Put(keys[i], values[i]); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// BatchDelete removes all keys with a single BPF_MAP_DELETE_BATCH, falling
+// back to one delete per key on kernels without the batch API. The batch
+// stops at a key that is already gone (the eBPF program removes expired
+// rules itself), in which case the rest are deleted one by one.
+func BatchDelete[K any](m *ebpf.Map, keys []K) error {
+	if len(keys) == 0 {
+		return nil
+	}
+	_, err := m.BatchDelete(keys, nil)
+	if !errors.Is(err, ebpf.ErrNotSupported) && !errors.Is(err, ebpf.ErrKeyNotExist) {
+		return err
+	}
+	for i := range keys {
+		if err := m.Delete(keys[i]); err != nil && !errors.Is(err, ebpf.ErrKeyNotExist) {
+			return err
+		}
+	}
+	return nil
+}
@@ -0,0 +1,12 @@
+module filter-common
+
+go 1.21
+
+require (
+	github.com/cilium/ebpf v0.12.3
+	github.com/vishvananda/netlink v1.1.0
+	github.com/vishvananda/netns v0.0.0-20191106174202-0a2b9b5464df
+	golang.org/x/sys v0.15.0
+)
+
+require golang.org/x/exp v0.0.0-20230224173230-c95f2b4c22f2 // indirect
@@ -0,0 +1,230 @@
+// Package sizing estimates the kernel memory of eBPF maps before they are
+// created, reads what the kernel charged once they are, and applies a
+// memlock budget.
+package sizing
+
+import (
+	"fmt"
+	"log"
+	"math/bits"
+	"os"
+	"sort"
+	"strconv"
+	"strings"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/rlimit"
+	"golang.org/x/sys/unix"
+)
+
+// Kernel bookkeeping per element, approximated from struct htab_elem, the
+// hash bucket and the LRU node on 64-bit kernels.
+const (
+	htabElemOverhead = 48
+	htabBucketSize   = 16
+	lruNodeOverhead  = 16
+	pageSize         = 4096
+	bloomHashes      = 5 // kernel default when map_extra is 0
+)
+
+// Map is the kernel memory of one map: an estimate from its
+// definition and, once created, the memlock the kernel charged for it.
+type Map struct {
+	name     string
+	spec     *ebpf.MapSpec
+	estimate uint64
+	memlock  uint64
+}
+
+func roundUp8(n uint32) uint64 {
+	return (uint64(n) + 7) &^ 7
+}
+
+func roundUpPow2(n uint64) uint64 {
+	if n <= 1 {
+		return 1
+	}
+	return 1 << bits.Len64(n-1)
+}
+
+// estimateMapMemory approximates what the kernel allocates for a map with
+// all entries in use. Per-CPU values are allocated for every possible CPU.
+func estimateMapMemory(spec *ebpf.MapSpec, cpus int) uint64 {
+	n := uint64(spec.MaxEntries)
+	key, value := roundUp8(spec.KeySize), roundUp8(spec.ValueSize)
+	buckets := roundUpPow2(n) * htabBucketSize
+	switch spec.Type {
+	case ebpf.Array:
+		return n * value
+	case ebpf.PerCPUArray:
+		return n*value*uint64(cpus) + n*8
+	case ebpf.Hash:
+		return n*(htabElemOverhead+key+value) + buckets
+	case ebpf.LRUHash:
+		return n*(htabElemOverhead+lruNodeOverhead+key+value) + buckets
+	case ebpf.PerCPUHash:
+		return n*(htabElemOverhead+key+8) + n*value*uint64(cpus) + buckets
+	case ebpf.LRUCPUHash:
+		return n*(htabElemOverhead+lruNodeOverhead+key+8) + n*value*uint64(cpus) + buckets
+	case ebpf.PerfEventArray:
+		if n == 0 {
+			n = uint64(cpus)
+		}
+		return n * 8
+	case ebpf.RingBuf:
+		return n + 2*pageSize
+	case ebpf.BloomFilter:
+		// nr_bits = entries * hashes / ln(2), rounded up to a power of two
+		return roundUpPow2(n*bloomHashes*100/69) / 8
+	default:
+		return n * (key + value)
+	}
+}
+
+// Spec estimates every map of a collection before it is loaded.
+func Spec(spec *ebpf.CollectionSpec) ([]Map, error) {
+	cpus, err := ebpf.PossibleCPU()
+	if err != nil {
+		return nil, err
+	}
+	sizes := make([]Map, 0, len(spec.Maps))
+	for name, m := range spec.Maps {
+		sizes = append(sizes, Map{name: name, spec: m, estimate: estimateMapMemory(m, cpus)})
+	}
+	sort.Slice(sizes, func(i, j int) bool { return sizes[i].name < sizes[j].name })
+	return sizes, nil
+}
+
+// Maps reports loaded maps, with the memlock from their fdinfo.
+func Maps(maps map[string]*ebpf.Map) ([]Map, error) {
+	cpus, err := ebpf.PossibleCPU()
+	if err != nil {
+		return nil, err
+	}
+	sizes := make([]Map, 0, len(maps))
+	for name, m := range maps {
+		spec := &ebpf.MapSpec{
+			Type:       m.Type(),
+			KeySize:    m.KeySize(),
+			ValueSize:  m.ValueSize(),
+			MaxEntries: m.MaxEntries(),
+			Flags:      m.Flags(),
+		}
+		memlock, err := MapMemlock(m)
+		if err != nil {
+			return nil, fmt.Errorf("%s: %w", name, err)
+		}
+		sizes = append(sizes, Map{name: name, spec: spec, estimate: estimateMapMemory(spec, cpus), memlock: memlock})
+	}
+	sort.Slice(sizes, func(i, j int) bool { return sizes[i].name < sizes[j].name })
+	return sizes, nil
+}
+
+// Print prints one line per map and the total, and warns when the
+// total is over budget (0 = no budget).
+func Print(sizes []Map, budget uint64) {
+	cpus, _ := ebpf.PossibleCPU()
+	fmt.Printf("📦 Map memory (%d possible CPUs)\n", cpus)
+	fmt.Printf("   %-20s %-14s %5s %6s %11s %11s %11s\n",
+		"map", "type", "key", "value", "max_entries", "estimate", "memlock")
+	var estimate, memlock uint64
+	for _, s := range sizes {
+		charged := "-"
+		if s.memlock > 0 {
+			charged = FormatSize(s.memlock)
+		}
+		fmt.Printf("   %-20s %-14s %5d %6d %11d %11s %11s\n", s.name, s.spec.Type,
+			s.spec.KeySize, s.spec.ValueSize, s.spec.MaxEntries, FormatSize(s.estimate), charged)
+		estimate += s.estimate
+		memlock += s.memlock
+	}
+	total := "-"
+	if memlock > 0 {
+		total = FormatSize(memlock)
+	}
+	fmt.Printf("   %-62s %11s %11s\n", "total", FormatSize(estimate), total)
+	if used := max(estimate, memlock); budget > 0 && used > budget {
+		fmt.Printf("⚠️  Maps need %s, over the memlock budget of %s\n", FormatSize(used), FormatSize(budget))
+	}
+}
+
+// SetupMemlock replaces the unconditional rlimit.RemoveMemlock. Without a
+// budget the limit is lifted as before. With one, the estimate for spec is
+// checked against it and RLIMIT_MEMLOCK is set to the budget; kernels that
+// charge maps to the memory cgroup instead ignore the rlimit, so the
+// warning is the guard there.
+func SetupMemlock(spec *ebpf.CollectionSpec, budget uint64) error {
+	sizes, err := Spec(spec)
+	if err != nil {
+		return err
+	}
+	var estimate uint64
+	for _, s := range sizes {
+		estimate += s.estimate
+	}
+	if budget == 0 {
+		fmt.Printf("📦 Maps need about %s of kernel memory\n", FormatSize(estimate))
+		return rlimit.RemoveMemlock()
+	}
+
+	fmt.Printf("📦 Maps need about %s of kernel memory (budget %s)\n", FormatSize(estimate), FormatSize(budget))
+	if estimate > budget {
+		log.Printf("⚠️  Estimated map memory %s exceeds the budget of %s; run the size command for a breakdown",
+			FormatSize(estimate), FormatSize(budget))
+	}
+	return unix.Setrlimit(unix.RLIMIT_MEMLOCK, &unix.Rlimit{Cur: budget, Max: budget})
+}
+
+// MapMemlock returns the kernel's memlock accounting for a map, as reported
+// in its fdinfo.
+func MapMemlock(m *ebpf.Map) (uint64, error) {
+	fdinfo, err := os.ReadFile(fmt.Sprintf("/proc/self/fdinfo/%d", m.FD()))
+	if err != nil {
+		return 0, err
+	}
+	for _, line := range strings.Split(string(fdinfo), "\n") {
+		if value, ok := strings.CutPrefix(line, "memlock:"); ok {
+			return strconv.ParseUint(strings.TrimSpace(value), 10, 64)
+		}
+	}
+	return 0, fmt.Errorf("no memlock in fdinfo")
+}
+
+// ParseSize parses a byte count with an optional K/M/G suffix (powers of
+// 1024), e.g. "512K", "64MiB" or "1G". An empty string is 0.
+func ParseSize(s string) (uint64, error) {
+	num := strings.TrimSuffix(strings.TrimSuffix(strings.ToUpper(strings.TrimSpace(s)), "B"), "I")
+	if num == "" {
+		return 0, nil
+	}
+	shift := 0
+	switch num[len(num)-1] {
+	case 'K':
+		shift = 10
+	case 'M':
+		shift = 20
+	case 'G':
+		shift = 30
+	}
+	if shift > 0 {
+		num = num[:len(num)-1]
+	}
+	n, err := strconv.ParseUint(num, 10, 64)
+	if err != nil {
+		return 0, fmt.Errorf("invalid size %q", s)
+	}
+	return n << shift, nil
+}
+
+// FormatSize formats a byte count with a binary unit.
+func FormatSize(b uint64) string {
+	switch {
+	case b >= 1<<30:
+		return fmt.Sprintf("%.1f GiB", float64(b)/(1<<30))
+	case b >= 1<<20:
+		return fmt.Sprintf("%.1f MiB", float64(b)/(1<<20))
+	case b >= 1<<10:
+		return fmt.Sprintf("%.1f KiB", float64(b)/(1<<10))
+	}
+	return fmt.Sprintf("%d B", b)
+}
@@ -0,0 +1,133 @@
+// Package trace collects the per-packet latency events of a FILTER_TRACE
+// build and prints a log2 histogram for each code path of the program.
+package trace
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"log"
+	"os"
+	"strings"
+	"sync"
+	"unsafe"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/perf"
+)
+
+// event mirrors struct trace_event in the eBPF programs.
+type event struct {
+	StartNs uint64
+	EndNs   uint64
+	Path    uint32
+	Verdict uint32
+}
+
+// nativeEndian is the byte order the programs write events in.
+var nativeEndian binary.ByteOrder = func() binary.ByteOrder {
+	x := uint16(1)
+	if *(*byte)(unsafe.Pointer(&x)) == 1 {
+		return binary.LittleEndian
+	}
+	return binary.BigEndian
+}()
+
+// latencyHist is a log2 histogram of per-packet program latency in ns.
+type latencyHist struct {
+	buckets [32]uint64
+	count   uint64
+	sum     uint64
+	min     uint64
+	max     uint64
+}
+
+func (h *latencyHist) add(ns uint64) {
+	b := 0
+	for v := ns; v > 1 && b < len(h.buckets)-1; v >>= 1 {
+		b++
+	}
+	h.buckets[b]++
+	if h.count == 0 || ns < h.min {
+		h.min = ns
+	}
+	if ns > h.max {
+		h.max = ns
+	}
+	h.count++
+	h.sum += ns
+}
+
+// Collector builds latency histograms per code path. Latencies include
+// the cost of the two bpf_ktime_get_ns calls themselves.
+type Collector struct {
+	names []string
+	mu    sync.Mutex
+	paths []latencyHist
+	lost  uint64
+}
+
+// NewCollector returns a collector for the code paths of enum trace_path
+// in the eBPF program, named in enum order.
+func NewCollector(pathNames []string) *Collector {
+	return &Collector{names: pathNames, paths: make([]latencyHist, len(pathNames))}
+}
+
+// Run consumes trace events until the reader is closed.
+func (tc *Collector) Run(rd *perf.Reader) {
+	for {
+		rec, err := rd.Read()
+		if errors.Is(err, perf.ErrClosed) {
+			return
+		}
+		if err != nil {
+			log.Printf("Failed to read trace event: %v", err)
+			continue
+		}
+
+		tc.mu.Lock()
+		tc.lost += rec.LostSamples
+		var ev event
+		if len(rec.RawSample) > 0 &&
+			binary.Read(bytes.NewReader(rec.RawSample), nativeEndian, &ev) == nil &&
+			int(ev.Path) < len(tc.paths) && ev.EndNs >= ev.StartNs {
+			tc.paths[ev.Path].add(ev.EndNs - ev.StartNs)
+		}
+		tc.mu.Unlock()
+	}
+}
+
+// Print shows the latency histogram of every code path seen so far.
+func (tc *Collector) Print() {
+	tc.mu.Lock()
+	defer tc.mu.Unlock()
+
+	fmt.Printf("🧭 Trace: per-path program latency (lost events: %d)\n", tc.lost)
+	for p, h := range tc.paths {
+		if h.count == 0 {
+			continue
+		}
+		fmt.Printf("  %-13s n=%-10d min=%dns avg=%dns max=%dns\n",
+			tc.names[p], h.count, h.min, h.sum/h.count, h.max)
+
+		var peak uint64
+		for _, n := range h.buckets {
+			if n > peak {
+				peak = n
+			}
+		}
+		for b, n := range h.buckets {
+			if n == 0 {
+				continue
+			}
+			fmt.Printf("   %8d-%-8d ns %10d %s\n", uint64(1)<<b, uint64(1)<<(b+1)-1, n,
+				strings.Repeat("█", int(n*40/peak)))
+		}
+	}
+}
+
+// NewReader opens the per-CPU trace buffers.
+func NewReader(m *ebpf.Map) (*perf.Reader, error) {
+	return perf.NewReader(m, 64*os.Getpagesize())
+}
@@ -0,0 +1,233 @@
+// Package traffic reads the per-verdict, packet-size and per-RX-queue
+// counters both XDP programs keep and prints them as rates.
+package traffic
+
+import (
+	"fmt"
+	"log"
+	"net"
+	"sort"
+	"strings"
+	"time"
+
+	"github.com/cilium/ebpf"
+)
+
+// Interval is how often the live statistics are printed.
+const Interval = 5 * time.Second
+
+// queueKey mirrors struct queue_key in the eBPF program.
+type queueKey struct {
+	Ifindex uint32
+	RxQueue uint32
+}
+
+// queueStats mirrors struct queue_stats in the eBPF program.
+type queueStats struct {
+	Pass  uint64
+	Drop  uint64
+	Bytes uint64
+}
+
+// Printer keeps the previous sample of the per-CPU counters so that each
+// tick can print rates rather than totals.
+type Printer struct {
+	trafficMap  *ebpf.Map
+	queueMap    *ebpf.Map
+	prevTraffic trafficStats
+	prevQueues  map[queueKey]queueStats
+	label       func(ifindex uint32) (string, bool)
+}
+
+// NewPrinter starts from the current counters, so the first tick shows
+// rates even when the maps were filled by an earlier process. label names
+// the interface behind an ifindex; only the attacher knows that for an
+// interface in another network namespace. Ifindexes it has no label for,
+// or all of them when label is nil, are looked up in the loader's namespace.
+func NewPrinter(trafficMap, queueMap *ebpf.Map, label func(ifindex uint32) (string, bool)) *Printer {
+	rp := &Printer{
+		trafficMap: trafficMap,
+		queueMap:   queueMap,
+		prevQueues: map[queueKey]queueStats{},
+		label:      label,
+	}
+	if traffic, err := readTrafficStats(trafficMap); err == nil {
+		rp.prevTraffic = traffic
+	}
+	if queues, err := readQueueStats(queueMap); err == nil {
+		rp.prevQueues = queues
+	}
+	return rp
+}
+
+// Print shows traffic and per-queue rates since the previous call.
+func (rp *Printer) Print(interval time.Duration) {
+	traffic, err := readTrafficStats(rp.trafficMap)
+	if err != nil {
+		log.Printf("Failed to read traffic statistics: %v", err)
+		return
+	}
+	showTrafficStats(rp.prevTraffic, traffic, interval)
+	rp.prevTraffic = traffic
+
+	queues, err := readQueueStats(rp.queueMap)
+	if err != nil {
+		log.Printf("Failed to read queue statistics: %v", err)
+		return
+	}
+	rp.showQueueStats(rp.prevQueues, queues, interval)
+	rp.prevQueues = queues
+}
+
+// Verdict slots and histogram size, as in the eBPF program.
+const (
+	verdictPass     = 0
+	verdictDrop     = 1
+	sizeHistBuckets = 16
+)
+
+// trafficStats mirrors struct traffic_stats in the eBPF program.
+type trafficStats struct {
+	Packets  [2]uint64
+	Bytes    [2]uint64
+	SizeHist [sizeHistBuckets]uint64
+}
+
+// readTrafficStats returns the verdict and packet-size counters summed over
+// all CPUs.
+func readTrafficStats(m *ebpf.Map) (trafficStats, error) {
+	var (
+		perCPU []trafficStats
+		sum    trafficStats
+	)
+	if err := m.Lookup(uint32(0), &perCPU); err != nil {
+		return sum, err
+	}
+	for _, s := range perCPU {
+		for v := range sum.Packets {
+			sum.Packets[v] += s.Packets[v]
+			sum.Bytes[v] += s.Bytes[v]
+		}
+		for b := range sum.SizeHist {
+			sum.SizeHist[b] += s.SizeHist[b]
+		}
+	}
+	return sum, nil
+}
+
+// showTrafficStats prints pps and bps per verdict over the last interval,
+// followed by the packet-size histogram for the same interval.
+func showTrafficStats(prev, cur trafficStats, interval time.Duration) {
+	secs := interval.Seconds()
+	rate := func(v int) (float64, float64) {
+		return float64(cur.Packets[v]-prev.Packets[v]) / secs,
+			float64(cur.Bytes[v]-prev.Bytes[v]) / secs
+	}
+	passPPS, passBPS := rate(verdictPass)
+	dropPPS, dropBPS := rate(verdictDrop)
+	fmt.Printf("📈 Traffic: pass %.0f pps / %s | drop %.0f pps / %s\n",
+		passPPS, FormatBitRate(passBPS), dropPPS, FormatBitRate(dropBPS))
+
+	var delta [sizeHistBuckets]uint64
+	var max uint64
+	for b := range delta {
+		delta[b] = cur.SizeHist[b] - prev.SizeHist[b]
+		if delta[b] > max {
+			max = delta[b]
+		}
+	}
+	if max == 0 {
+		return
+	}
+	for b, n := range delta {
+		if n == 0 {
+			continue
+		}
+		fmt.Printf("   %6d-%-6d B %10d %s\n", 1<<b, 1<<(b+1)-1, n,
+			strings.Repeat("█", int(n*40/max)))
+	}
+}
+
+// FormatBitRate renders a byte rate as bits per second.
+func FormatBitRate(bytesPerSec float64) string {
+	bps := bytesPerSec * 8
+	switch {
+	case bps >= 1e9:
+		return fmt.Sprintf("%.2f Gbps", bps/1e9)
+	case bps >= 1e6:
+		return fmt.Sprintf("%.2f Mbps", bps/1e6)
+	case bps >= 1e3:
+		return fmt.Sprintf("%.2f kbps", bps/1e3)
+	}
+	return fmt.Sprintf("%.0f bps", bps)
+}
+
+// readQueueStats returns the per-queue counters summed over all CPUs.
+func readQueueStats(m *ebpf.Map) (map[queueKey]queueStats, error) {
+	var (
+		key    queueKey
+		perCPU []queueStats
+		totals = make(map[queueKey]queueStats)
+	)
+	iter := m.Iterate()
+	for iter.Next(&key, &perCPU) {
+		var sum queueStats
+		for _, s := range perCPU {
+			sum.Pass += s.Pass
+			sum.Drop += s.Drop
+			sum.Bytes += s.Bytes
+		}
+		totals[key] = sum
+	}
+	return totals, iter.Err()
+}
+
+// showQueueStats prints per-queue rates over the last interval. A queue
+// carrying more than twice its even share of packets is flagged, which is
+// what a flood steered onto one RSS queue looks like.
+func (rp *Printer) showQueueStats(prev, cur map[queueKey]queueStats, interval time.Duration) {
+	keys := make([]queueKey, 0, len(cur))
+	var totalPkts uint64
+	for k, s := range cur {
+		keys = append(keys, k)
+		p := prev[k]
+		totalPkts += (s.Pass - p.Pass) + (s.Drop - p.Drop)
+	}
+	sort.Slice(keys, func(i, j int) bool {
+		if keys[i].Ifindex != keys[j].Ifindex {
+			return keys[i].Ifindex < keys[j].Ifindex
+		}
+		return keys[i].RxQueue < keys[j].RxQueue
+	})
+
+	secs := interval.Seconds()
+	fmt.Printf("%-12s %5s %12s %12s %14s %7s\n", "IFACE", "QUEUE", "PASS/s", "DROP/s", "BYTES/s", "SHARE")
+	for _, k := range keys {
+		s, p := cur[k], prev[k]
+		pkts := (s.Pass - p.Pass) + (s.Drop - p.Drop)
+		share := 0.0
+		if totalPkts > 0 {
+			share = float64(pkts) / float64(totalPkts)
+		}
+		hot := ""
+		if len(keys) > 1 && share > 2/float64(len(keys)) {
+			hot = " 🔥 hot"
+		}
+		fmt.Printf("%-12s %5d %12.0f %12.0f %14.0f %6.1f%%%s\n",
+			rp.ifaceName(k.Ifindex), k.RxQueue,
+			float64(s.Pass-p.Pass)/secs, float64(s.Drop-p.Drop)/secs,
+			float64(s.Bytes-p.Bytes)/secs, share*100, hot)
+	}
+}
+
+func (rp *Printer) ifaceName(index uint32) string {
+	if rp.label != nil {
+		if name, ok := rp.label(index); ok {
+			return name
+		}
+	}
+	if iface, err := net.InterfaceByIndex(int(index)); err == nil {
+		return iface.Name
+	}
+	return fmt.Sprintf("if%d", index)
+}
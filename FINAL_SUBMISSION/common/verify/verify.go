@@ -0,0 +1,206 @@
+// Package verify loads eBPF programs through the verifier and checks what
+// they cost against a budget committed next to their source.
+package verify
+
+import (
+	"encoding/json"
+	"errors"
+	"flag"
+	"fmt"
+	"log"
+	"os"
+	"regexp"
+	"runtime"
+	"sort"
+	"strconv"
+	"unsafe"
+
+	"filter-common/sizing"
+	"github.com/cilium/ebpf"
+	"golang.org/x/sys/unix"
+)
+
+// verifierBudgetFile holds the per-program limits "verify" enforces. It is
+// committed next to the eBPF source so that growth shows up in review.
+const verifierBudgetFile = "verifier_budget.json"
+
+// verifierHeadroom is the growth, in percent, "verify -record" allows over
+// the numbers it measures.
+const verifierHeadroom = 10
+
+// verifierStats is the cost of one program as the kernel sees it. Insns and
+// JitedBytes track per-packet cost, VerifiedInsns tracks how close the
+// program is to the verifier's complexity limit.
+type verifierStats struct {
+	Insns         uint32 `json:"insns"`          // after verifier rewrites
+	VerifiedInsns uint32 `json:"verified_insns"` // instructions the verifier walked
+	JitedBytes    uint32 `json:"jited_bytes"`    // 0 when the JIT is off
+}
+
+// bpfProgInfo mirrors struct bpf_prog_info up to verified_insns (Linux
+// 5.16). Older kernels leave VerifiedInsns zero.
+type bpfProgInfo struct {
+	Type          uint32
+	ID            uint32
+	Tag           [8]byte
+	JitedProgLen  uint32
+	XlatedProgLen uint32
+	_             [192]byte
+	VerifiedInsns uint32
+}
+
+const bpfObjGetInfoByFD = 15
+
+// progInfo reads a loaded program's info with BPF_OBJ_GET_INFO_BY_FD.
+func progInfo(prog *ebpf.Program) (bpfProgInfo, error) {
+	var info bpfProgInfo
+	attr := struct {
+		fd      uint32
+		infoLen uint32
+		info    uint64
+	}{uint32(prog.FD()), uint32(unsafe.Sizeof(info)), uint64(uintptr(unsafe.Pointer(&info)))}
+	_, _, errno := unix.Syscall(unix.SYS_BPF, bpfObjGetInfoByFD, uintptr(unsafe.Pointer(&attr)), unsafe.Sizeof(attr))
+	runtime.KeepAlive(&info)
+	if errno != 0 {
+		return info, errno
+	}
+	return info, nil
+}
+
+// processedInsns matches the LogLevelStats summary line of the verifier.
+var processedInsns = regexp.MustCompile(`processed (\d+) insns`)
+
+// verifyPrograms loads every program of spec through the verifier and
+// returns what each one costs.
+func verifyPrograms(spec *ebpf.CollectionSpec) (map[string]verifierStats, error) {
+	coll, err := ebpf.NewCollectionWithOptions(spec, ebpf.CollectionOptions{
+		Programs: ebpf.ProgramOptions{LogLevel: ebpf.LogLevelStats},
+	})
+	if err != nil {
+		return nil, err
+	}
+	defer coll.Close()
+
+	stats := make(map[string]verifierStats, len(coll.Programs))
+	for name, prog := range coll.Programs {
+		info, err := progInfo(prog)
+		if err != nil {
+			return nil, fmt.Errorf("%s: %w", name, err)
+		}
+		s := verifierStats{
+			Insns:         info.XlatedProgLen / 8,
+			VerifiedInsns: info.VerifiedInsns,
+			JitedBytes:    info.JitedProgLen,
+		}
+		if s.VerifiedInsns == 0 {
+			if m := processedInsns.FindStringSubmatch(prog.VerifierLog); m != nil {
+				n, _ := strconv.ParseUint(m[1], 10, 32)
+				s.VerifiedInsns = uint32(n)
+			}
+		}
+		stats[name] = s
+	}
+	return stats, nil
+}
+
+// Run loads the collections specs returns through the verifier and checks
+// their size against the budget. specs gets the object files named on the
+// command line, or none to use the loader's embedded ones. Programs of a
+// FILTER_TRACE build are budgeted under a "trace/" prefix.
+// Arguments: [-record] [-budget budget.json] [object.o ...]
+func Run(args []string, specs func(objects []string) ([]*ebpf.CollectionSpec, error)) {
+	fs := flag.NewFlagSet("verify", flag.ExitOnError)
+	record := fs.Bool("record", false, "rewrite the budget from the measured numbers plus headroom")
+	path := fs.String("budget", verifierBudgetFile, "verifier budget file")
+	fs.Parse(args)
+
+	loaded, err := specs(fs.Args())
+	if err != nil {
+		log.Fatalf("Failed to load eBPF spec: %v", err)
+	}
+	stats := make(map[string]verifierStats)
+	for _, spec := range loaded {
+		if err := sizing.SetupMemlock(spec, 0); err != nil {
+			log.Fatalf("Failed to remove memlock limit: %v", err)
+		}
+		progs, err := verifyPrograms(spec)
+		if err != nil {
+			log.Fatalf("Failed to load eBPF programs: %v", err)
+		}
+		prefix := ""
+		if _, ok := spec.Maps["trace_events"]; ok {
+			prefix = "trace/"
+		}
+		for name, s := range progs {
+			stats[prefix+name] = s
+		}
+	}
+	checkVerifierBudget(stats, *path, *record)
+}
+
+// checkVerifierBudget prints the verifier report and compares it with the
+// budget file. With record, the budget is rewritten from the report plus
+// verifierHeadroom instead. It exits non-zero if any program is over
+// budget, so that build.sh fails; without a budget file there is nothing
+// to enforce and it only warns.
+func checkVerifierBudget(stats map[string]verifierStats, path string, record bool) {
+	names := make([]string, 0, len(stats))
+	for name := range stats {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+
+	if record {
+		budget := make(map[string]verifierStats, len(stats))
+		for name, s := range stats {
+			grow := func(v uint32) uint32 { return v + v*verifierHeadroom/100 + 1 }
+			budget[name] = verifierStats{grow(s.Insns), grow(s.VerifiedInsns), grow(s.JitedBytes)}
+		}
+		data, err := json.MarshalIndent(budget, "", "  ")
+		if err != nil {
+			log.Fatalf("Failed to encode verifier budget: %v", err)
+		}
+		if err := os.WriteFile(path, append(data, '\n'), 0644); err != nil {
+			log.Fatalf("Failed to write verifier budget: %v", err)
+		}
+		fmt.Printf("📝 Recorded verifier budget for %d program(s) in %s (+%d%%)\n", len(stats), path, verifierHeadroom)
+	}
+
+	budget := make(map[string]verifierStats)
+	data, err := os.ReadFile(path)
+	if errors.Is(err, os.ErrNotExist) {
+		fmt.Printf("⚠️  No verifier budget at %s, skipping the check; run verify -record on a reference kernel and commit it\n", path)
+		return
+	} else if err != nil {
+		log.Fatalf("Failed to read verifier budget: %v", err)
+	}
+	if err := json.Unmarshal(data, &budget); err != nil {
+		log.Fatalf("Failed to parse verifier budget %s: %v", path, err)
+	}
+
+	over := 0
+	check := func(got, limit uint32) string {
+		if got > limit {
+			over++
+			return fmt.Sprintf("%d ❌", got)
+		}
+		return strconv.FormatUint(uint64(got), 10)
+	}
+	fmt.Printf("%-32s %14s %16s %14s\n", "PROGRAM", "INSNS", "VERIFIED INSNS", "JITED BYTES")
+	for _, name := range names {
+		s := stats[name]
+		limit, ok := budget[name]
+		if !ok {
+			over++
+			fmt.Printf("%-32s no budget ❌\n", name)
+			continue
+		}
+		fmt.Printf("%-32s %14s %16s %14s\n", name,
+			check(s.Insns, limit.Insns), check(s.VerifiedInsns, limit.VerifiedInsns), check(s.JitedBytes, limit.JitedBytes))
+	}
+	if over > 0 {
+		fmt.Printf("❌ %d value(s) over the verifier budget in %s\n", over, path)
+		os.Exit(1)
+	}
+	fmt.Printf("✅ All programs within the verifier budget in %s\n", path)
+}